@@ -63,6 +63,17 @@ static CFDictionaryRef eapOptions = NULL;
 static struct EAP_Packet	*eapSavePacket = NULL;
 static int eap_in_ui = 0;
 
+/* handshake step run by a pppd worker thread, when pppd supports it */
+typedef struct eaptls_job {
+	struct EAP_Packet	*pkt_in;	/* our copy of the packet to process */
+	struct EAP_Packet	*pkt_out;
+	EAPClientState		state;
+	EAPClientStatus		status;
+	EAPClientDomainSpecificError error;
+} eaptls_job;
+
+static eaptls_job eapJob;
+
 
 extern EAPClientPluginFuncRef
 eaptls_introspect(EAPClientPluginFuncName name);
@@ -234,6 +245,16 @@ failed:
 int Dispose(void *context)
 {
 
+	/* pppd doesn't dispose us while the job runs, but it may drop it once done */
+	if (eapJob.pkt_out) {
+		EAPClientModulePluginFreePacket(eapRef, &eapData, (EAPPacketRef)eapJob.pkt_out);
+		eapJob.pkt_out = 0;
+	}
+	if (eapJob.pkt_in) {
+		free(eapJob.pkt_in);
+		eapJob.pkt_in = 0;
+	}
+
 	EAPClientModulePluginFree(eapRef, &eapData);
 	eapRef = 0;
 	
@@ -256,7 +277,7 @@ int Dispose(void *context)
 		free(eapSavePacket);
 		eapSavePacket = 0;
 	}
-	
+
 	if (initialized_UI) {
 		eaptls_ui_dispose();
 	}
@@ -264,6 +285,40 @@ int Dispose(void *context)
     return EAP_NO_ERROR;
 }
 
+/* ------------------------------------------------------------------------------------
+run the TLS handshake step on a worker thread.
+certificate operations and chain evaluation can take a while, and pppd 
+would otherwise stop serving its timers and LCP echos meanwhile.
+no logging from here, the pppd log functions are not thread safe.
+------------------------------------------------------------------------------------ */ 
+static void process_job(void *arg)
+{
+	eaptls_job *job = (eaptls_job *)arg;
+
+	job->state = EAPClientModulePluginProcess(eapRef, &eapData, (EAPPacketRef)job->pkt_in, 
+						(EAPPacketRef*)&job->pkt_out, &job->status, &job->error);
+}
+
+/* ------------------------------------------------------------------------------------
+------------------------------------------------------------------------------------ */ 
+static int submit_job(struct EAP_Input *eap_in, struct EAP_Packet *pkt_in)
+{
+	int len = ntohs(pkt_in->len);
+
+	bzero(&eapJob, sizeof(eapJob));
+	eapJob.pkt_in = malloc(len);
+	if (eapJob.pkt_in == NULL)
+		return -1;
+	bcopy(pkt_in, eapJob.pkt_in, len);
+
+	if (eap_in->async_submit(eap_in, process_job, &eapJob)) {
+		free(eapJob.pkt_in);
+		eapJob.pkt_in = 0;
+		return -1;
+	}
+	return 0;
+}
+
 /* ------------------------------------------------------------------------------------
 ------------------------------------------------------------------------------------ */ 
 int Process(void *context, struct EAP_Input *eap_in, struct EAP_Output *eap_out) 
@@ -274,8 +329,9 @@ int Process(void *context, struct EAP_Input *eap_in, struct EAP_Output *eap_out)
 	EAPClientState	state;
 	EAPClientDomainSpecificError error;
 	eaptls_ui_ctx *ui_ctx_in;
-	int do_process = 0;
+	int do_process = 0, do_result = 0;
 	CFDictionaryRef	publish_prop;
+	eaptls_job *job = NULL;
 	
 	// by default, ignore the message
 	eap_out->action = EAP_ACTION_NONE;
@@ -319,11 +375,31 @@ int Process(void *context, struct EAP_Input *eap_in, struct EAP_Output *eap_out)
 			pkt_in = (struct EAP_Packet *)eap_in->data;
 			do_process = 1;
 			break;
+
+		case EAP_NOTIFICATION_ASYNC_DONE:
+
+			job = (eaptls_job *)eap_in->data;
+			pkt_in = job->pkt_in;
+			pkt_out = job->pkt_out;
+			state = job->state;
+			status = job->status;
+			error = job->error;
+			do_result = 1;
+			break;
 	}
 
 	if (do_process) {
+
+		if (pkt_in && EAP_INPUT_HAS_ASYNC(eap_in) && submit_job(eap_in, pkt_in) == 0)
+			eap_out->action = EAP_ACTION_PENDING;
+		else {
+			state = EAPClientModulePluginProcess(eapRef, &eapData, (EAPPacketRef)pkt_in, (EAPPacketRef*)&pkt_out, &status, &error);
+			do_result = 1;
+		}
+	}
+
+	if (do_result) {
 		
-		state = EAPClientModulePluginProcess(eapRef, &eapData, (EAPPacketRef)pkt_in, (EAPPacketRef*)&pkt_out, &status, &error);
 		switch(state) {
 			case kEAPClientStateAuthenticating:
 				switch (status) {
@@ -380,6 +456,13 @@ int Process(void *context, struct EAP_Input *eap_in, struct EAP_Output *eap_out)
 		eapSavePacket = 0;
 	}	
 
+	if (job) {
+		/* pkt_out now belongs to eap_out, or is handled like a synchronous one */
+		free(job->pkt_in);
+		job->pkt_in = 0;
+		job->pkt_out = 0;
+	}
+
     return 0;
 }
 
@@ -946,12 +946,15 @@ radius_decryptmppekey(char *key, u_int8_t *attr_value, size_t attr_len, char *se
     int i;
     u_char  plain[32];
     u_char  buf[16];
-    MD5_CTX ctx;
+    MD5_CTX ctx, secret_ctx;
 			
     memcpy(plain, attr_value + 2, sizeof(plain)); /* key string */
 
-    MD5_Init(&ctx);
-    MD5_Update(&ctx, secret, strlen(secret));
+    /* both blocks are keyed with the secret, hash it only once */
+    MD5_Init(&secret_ctx);
+    MD5_Update(&secret_ctx, secret, strlen(secret));
+
+    ctx = secret_ctx;
 	MD5_Update(&ctx, authenticator, auth_len);
     MD5_Update(&ctx, attr_value, 2); /* salt */
     MD5_Final(buf, &ctx);
@@ -959,8 +962,7 @@ radius_decryptmppekey(char *key, u_int8_t *attr_value, size_t attr_len, char *se
     for (i = 0; i < 16; i++)
 		plain[i] ^= buf[i];
 
-    MD5_Init(&ctx);
-    MD5_Update(&ctx, secret, strlen(secret));
+    ctx = secret_ctx;
     MD5_Update(&ctx, attr_value + 2, 16); /* key string */
     MD5_Final(buf, &ctx);
 
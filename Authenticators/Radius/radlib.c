@@ -52,7 +52,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-#include <CommonCrypto/CommonHMAC.h>
+#include <CommonCrypto/CommonDigest.h>
 
 #define MD5Init MD5_Init
 #define MD5Update MD5_Update
@@ -87,6 +87,9 @@
 static void	 clear_password(struct rad_handle *);
 static void	 generr(struct rad_handle *, const char *, ...);
 //		    __printflike(2, 3);
+static void	 hmac_md5_init(const struct rad_server *, MD5_CTX *);
+static void	 hmac_md5_final(const struct rad_server *, MD5_CTX *,
+		    u_char *);
 static void	 insert_scrambled_password(struct rad_handle *, int);
 static void	 insert_request_authenticator(struct rad_handle *, int);
 static void	 insert_message_authenticator(struct rad_handle *, int);
@@ -96,6 +99,8 @@ static int	 put_password_attr(struct rad_handle *, int,
 		    const void *, size_t);
 static int	 put_raw_attr(struct rad_handle *, int,
 		    const void *, size_t);
+static void	 secret_init(struct rad_server *);
+static void	 secret_clear(struct rad_server *);
 static int	 split(char *, char *[], int, char *, size_t);
 
 static void
@@ -118,6 +123,75 @@ generr(struct rad_handle *h, const char *format, ...)
 	va_end(ap);
 }
 
+/*
+ * Every digest we compute is keyed with the shared secret of the server,
+ * either as a prefix (password hiding, RFC 2865 section 5.2) or as the
+ * HMAC-MD5 key (Message-Authenticator, RFC 3579 section 3.2).  Hash the
+ * secret once when the server is added and start each digest from a copy
+ * of the saved state instead of rehashing it for every packet and block.
+ */
+static void
+secret_init(struct rad_server *srvp)
+{
+	u_char key[CC_MD5_BLOCK_BYTES], pad[CC_MD5_BLOCK_BYTES];
+	int i;
+
+	srvp->secret_len = strlen(srvp->secret);
+	MD5Init(&srvp->secret_md5);
+	MD5Update(&srvp->secret_md5, srvp->secret, (CC_LONG)srvp->secret_len);
+
+	/* Keys longer than a block are replaced by their digest (RFC 2104) */
+	memset(key, 0, sizeof key);
+	if (srvp->secret_len > sizeof key)
+		CC_MD5(srvp->secret, (CC_LONG)srvp->secret_len, key);
+	else
+		memcpy(key, srvp->secret, srvp->secret_len);
+
+	for (i = 0;  i < sizeof pad;  i++)
+		pad[i] = key[i] ^ 0x36;
+	MD5Init(&srvp->hmac_inner);
+	MD5Update(&srvp->hmac_inner, pad, sizeof pad);
+	for (i = 0;  i < sizeof pad;  i++)
+		pad[i] = key[i] ^ 0x5c;
+	MD5Init(&srvp->hmac_outer);
+	MD5Update(&srvp->hmac_outer, pad, sizeof pad);
+
+	memset(key, 0, sizeof key);
+	memset(pad, 0, sizeof pad);
+}
+
+static void
+secret_clear(struct rad_server *srvp)
+{
+	memset(srvp->secret, 0, srvp->secret_len);
+	free(srvp->secret);
+	srvp->secret = NULL;
+	srvp->secret_len = 0;
+	memset(&srvp->secret_md5, 0, sizeof srvp->secret_md5);
+	memset(&srvp->hmac_inner, 0, sizeof srvp->hmac_inner);
+	memset(&srvp->hmac_outer, 0, sizeof srvp->hmac_outer);
+}
+
+/*
+ * HMAC-MD5 keyed with the server secret: hmac_md5_init() returns a context
+ * the message is fed to with MD5Update(), hmac_md5_final() stores the
+ * MD5_DIGEST_LENGTH bytes of the MAC in md.
+ */
+static void
+hmac_md5_init(const struct rad_server *srvp, MD5_CTX *ctx)
+{
+	*ctx = srvp->hmac_inner;
+}
+
+static void
+hmac_md5_final(const struct rad_server *srvp, MD5_CTX *ctx, u_char *md)
+{
+	MD5Final(md, ctx);
+	*ctx = srvp->hmac_outer;
+	MD5Update(ctx, md, MD5_DIGEST_LENGTH);
+	MD5Final(md, ctx);
+}
+
 static void
 insert_scrambled_password(struct rad_handle *h, int srv)
 {
@@ -135,8 +209,7 @@ insert_scrambled_password(struct rad_handle *h, int srv)
 		int i;
 
 		/* Calculate the new scrambler */
-		MD5_Init(&ctx);
-		MD5Update(&ctx, srvp->secret, strlen(srvp->secret));
+		ctx = srvp->secret_md5;
 		MD5Update(&ctx, md5, 16);
 		MD5Final(md5, &ctx);
 
@@ -165,29 +238,29 @@ insert_request_authenticator(struct rad_handle *h, int srv)
 	MD5Update(&ctx, &h->request[POS_CODE], POS_AUTH - POS_CODE);
 	MD5Update(&ctx, memset(&h->request[POS_AUTH], 0, LEN_AUTH), LEN_AUTH);
 	MD5Update(&ctx, &h->request[POS_ATTRS], h->req_len - POS_ATTRS);
-	MD5Update(&ctx, srvp->secret, strlen(srvp->secret));
+	MD5Update(&ctx, srvp->secret, (CC_LONG)srvp->secret_len);
 	MD5Final(&h->request[POS_AUTH], &ctx);
 }
 
 static void
 insert_message_authenticator(struct rad_handle *h, int srv)
 {
-	u_char md[CC_MD5_DIGEST_LENGTH];
+	u_char md[MD5_DIGEST_LENGTH];
 	const struct rad_server *srvp;
-	CCHmacContext ctx;
+	MD5_CTX ctx;
 	srvp = &h->servers[srv];
 
 	if (h->authentic_pos != 0) {
 		// first clear the authenticator field of the request
 		memset(&h->request[h->authentic_pos + 2], 0, MD5_DIGEST_LENGTH);
 
-		CCHmacInit(&ctx, kCCHmacAlgMD5, srvp->secret, strlen(srvp->secret));
-		CCHmacUpdate(&ctx, &h->request[POS_CODE], POS_AUTH - POS_CODE);
-		CCHmacUpdate(&ctx, &h->request[POS_AUTH], LEN_AUTH);
-		CCHmacUpdate(&ctx, &h->request[POS_ATTRS],
+		hmac_md5_init(srvp, &ctx);
+		MD5Update(&ctx, &h->request[POS_CODE], POS_AUTH - POS_CODE);
+		MD5Update(&ctx, &h->request[POS_AUTH], LEN_AUTH);
+		MD5Update(&ctx, &h->request[POS_ATTRS],
 		    h->req_len - POS_ATTRS);
-		CCHmacFinal(&ctx, md);
-		memcpy(&h->request[h->authentic_pos + 2], md, CC_MD5_DIGEST_LENGTH);
+		hmac_md5_final(srvp, &ctx, md);
+		memcpy(&h->request[h->authentic_pos + 2], md, MD5_DIGEST_LENGTH);
 	}
 }
 
@@ -203,8 +276,8 @@ is_valid_response(struct rad_handle *h, int srv,
 	unsigned char md5[MD5_DIGEST_LENGTH];
 	const struct rad_server *srvp;
 	int alen, len;
-	CCHmacContext hctx;
-	u_char resp[MSGSIZE], md[CC_MD5_DIGEST_LENGTH];
+	u_char md[MD5_DIGEST_LENGTH];
+	static const u_char zero[MD5_DIGEST_LENGTH];
 	int pos;
 
 	srvp = &h->servers[srv];
@@ -227,7 +300,7 @@ is_valid_response(struct rad_handle *h, int srv,
 	MD5Update(&ctx, &h->response[POS_CODE], POS_AUTH - POS_CODE);
 	MD5Update(&ctx, &h->request[POS_AUTH], LEN_AUTH);
 	MD5Update(&ctx, &h->response[POS_ATTRS], len - POS_ATTRS);
-	MD5Update(&ctx, srvp->secret, strlen(srvp->secret));
+	MD5Update(&ctx, srvp->secret, (CC_LONG)srvp->secret_len);
 	MD5Final(md5, &ctx);
 	if (memcmp(&h->response[POS_AUTH], md5, sizeof md5) != 0)
 		return 0;
@@ -238,7 +311,6 @@ is_valid_response(struct rad_handle *h, int srv,
 	 */
 	if (h->response[POS_CODE] != RAD_ACCOUNTING_RESPONSE) {
 
-		memcpy(resp, h->response, MSGSIZE);
 		pos = POS_ATTRS;
 
 		/* Search and verify the Message-Authenticator */
@@ -249,17 +321,23 @@ is_valid_response(struct rad_handle *h, int srv,
 				if (len - pos < MD5_DIGEST_LENGTH + 2)
 					return 0;
 
-				memset(&resp[pos + 2], 0, MD5_DIGEST_LENGTH);
-
-				CCHmacInit(&hctx, kCCHmacAlgMD5, srvp->secret,
-				    strlen(srvp->secret));
-				CCHmacUpdate(&hctx, &h->response[POS_CODE],
+				/*
+				 * The MAC is computed with the attribute
+				 * zeroed: hash around it rather than
+				 * patching a copy of the response.
+				 */
+				hmac_md5_init(srvp, &ctx);
+				MD5Update(&ctx, &h->response[POS_CODE],
 				    POS_AUTH - POS_CODE);
-				CCHmacUpdate(&hctx, &h->request[POS_AUTH],
+				MD5Update(&ctx, &h->request[POS_AUTH],
 				    LEN_AUTH);
-				CCHmacUpdate(&hctx, &resp[POS_ATTRS],
-				    h->resp_len - POS_ATTRS);
-				CCHmacFinal(&hctx, md);
+				MD5Update(&ctx, &h->response[POS_ATTRS],
+				    pos + 2 - POS_ATTRS);
+				MD5Update(&ctx, zero, MD5_DIGEST_LENGTH);
+				MD5Update(&ctx,
+				    &h->response[pos + 2 + MD5_DIGEST_LENGTH],
+				    h->resp_len - (pos + 2 + MD5_DIGEST_LENGTH));
+				hmac_md5_final(srvp, &ctx, md);
 				if (memcmp(md, &h->response[pos + 2],
 				    MD5_DIGEST_LENGTH) != 0)
 					return 0;
@@ -365,6 +443,7 @@ rad_add_server(struct rad_handle *h, const char *host, int port,
 		generr(h, "Out of memory");
 		return -1;
 	}
+	secret_init(srvp);
 	srvp->timeout = timeout;
 	srvp->max_tries = tries;
 	srvp->num_tries = 0;
@@ -379,11 +458,8 @@ rad_close(struct rad_handle *h)
 
 	if (h->fd != -1)
 		close(h->fd);
-	for (srv = 0;  srv < h->num_servers;  srv++) {
-		memset(h->servers[srv].secret, 0,
-		    strlen(h->servers[srv].secret));
-		free(h->servers[srv].secret);
-	}
+	for (srv = 0;  srv < h->num_servers;  srv++)
+		secret_clear(&h->servers[srv]);
 	clear_password(h);
 	free(h);
 }
@@ -1145,7 +1221,7 @@ u_char *
 rad_demangle(struct rad_handle *h, const void *mangled, size_t mlen)
 {
 	char R[LEN_AUTH];
-	const char *S;
+	const struct rad_server *srvp;
 	int i, Ppos;
 	MD5_CTX Context;
 	u_char b[MD5_DIGEST_LENGTH], *C, *demangled;
@@ -1159,7 +1235,7 @@ rad_demangle(struct rad_handle *h, const void *mangled, size_t mlen)
 	C = (u_char *)mangled;
 
 	/* We need the shared secret as Salt */
-	S = rad_server_secret(h);
+	srvp = &h->servers[h->srv];
 
 	/* We need the request authenticator */
 	if (rad_request_authenticator(h, R, sizeof R) != LEN_AUTH) {
@@ -1171,8 +1247,7 @@ rad_demangle(struct rad_handle *h, const void *mangled, size_t mlen)
 	if (!demangled)
 		return NULL;
 
-	MD5Init(&Context);
-	MD5Update(&Context, S, strlen(S));
+	Context = srvp->secret_md5;
 	MD5Update(&Context, R, LEN_AUTH);
 	MD5Final(b, &Context);
 	Ppos = 0;
@@ -1183,8 +1258,7 @@ rad_demangle(struct rad_handle *h, const void *mangled, size_t mlen)
 			demangled[Ppos++] = C[i] ^ b[i];
 
 		if (mlen) {
-			MD5Init(&Context);
-			MD5Update(&Context, S, strlen(S));
+			Context = srvp->secret_md5;
 			MD5Update(&Context, C, 16);
 			MD5Final(b, &Context);
 		}
@@ -1200,11 +1274,11 @@ rad_demangle_mppe_key(struct rad_handle *h, const void *mangled,
     size_t mlen, size_t *len)
 {
 	char R[LEN_AUTH];    /* variable names as per rfc2548 */
-	const char *S;
+	const struct rad_server *srvp;
 	u_char b[MD5_DIGEST_LENGTH], *demangled;
 	const u_char *A, *C;
 	MD5_CTX Context;
-	int Slen, i, Clen, Ppos;
+	int i, Clen, Ppos;
 	u_char *P;
 
 	if (mlen % 16 != SALT_LEN) {
@@ -1222,16 +1296,14 @@ rad_demangle_mppe_key(struct rad_handle *h, const void *mangled,
 	A = (const u_char *)mangled;      /* Salt comes first */
 	C = (const u_char *)mangled + SALT_LEN;  /* Then the ciphertext */
 	Clen = (int)(mlen - SALT_LEN);
-	S = rad_server_secret(h);    /* We need the RADIUS secret */
-	Slen = (int)strlen(S);
+	srvp = &h->servers[h->srv];    /* We need the RADIUS secret */
 	P = calloc(Clen, 1);        /* We derive our plaintext */
 	if (!P) {
 		generr(h, "Cannot obtain the RADIUS MPPE plaintext buffer");
 		return NULL;
 	}
 
-	MD5Init(&Context);
-	MD5Update(&Context, S, Slen);
+	Context = srvp->secret_md5;
 	MD5Update(&Context, R, LEN_AUTH);
 	MD5Update(&Context, A, SALT_LEN);
 	MD5Final(b, &Context);
@@ -1244,8 +1316,7 @@ rad_demangle_mppe_key(struct rad_handle *h, const void *mangled,
 		    P[Ppos++] = C[i] ^ b[i];
 
 		if (Clen) {
-			MD5Init(&Context);
-			MD5Update(&Context, S, Slen);
+			Context = srvp->secret_md5;
 			MD5Update(&Context, C, 16);
 			MD5Final(b, &Context);
 		}
@@ -52,6 +52,7 @@
 
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <CommonCrypto/CommonDigest.h>
 
 #include "radlib.h"
 #include "radlib_vs.h"
@@ -85,6 +86,10 @@
 struct rad_server {
 	struct sockaddr_in addr;	/* Address of server */
 	char		*secret;	/* Shared secret */
+	size_t		 secret_len;	/* Length of shared secret */
+	MD5_CTX		 secret_md5;	/* MD5 state after the secret */
+	MD5_CTX		 hmac_inner;	/* HMAC-MD5 state after K ^ ipad */
+	MD5_CTX		 hmac_outer;	/* HMAC-MD5 state after K ^ opad */
 	int		 timeout;	/* Timeout in seconds */
 	int		 max_tries;	/* Number of tries before giving up */
 	int		 num_tries;	/* Number of tries so far */
@@ -660,53 +660,135 @@ void writeparam(int fd, char *param)
 }
 
 /* -----------------------------------------------------------------------------
+options for pppd are collected in memory and sent in a single write,
+as a binary block of words (see CONTROLLER_TLV_TAG in pppd.h)
+framed by the usual [OPTIONS] and [EOP] text markers
 ----------------------------------------------------------------------------- */
+struct pppd_params {
+    u_char	*data;
+    size_t	len;
+    size_t	size;
+    size_t	block;		/* offset of the block, after its length */
+    int		error;
+};
+
 static 
-void writeintparam(int fd, char *param, u_int32_t val)
+void appendparams(struct pppd_params *params, const void *data, size_t len)
 {
-    u_char	str[32];
-    
-    writeparam(fd, param);
-    snprintf((char*)str, sizeof(str), "%d", val);
-    writeparam(fd, (char*)str);
+    u_char	*newdata;
+    size_t	size;
+
+    if (params->error)
+        return;
+
+    if (params->len + len > params->size) {
+        for (size = params->size ? params->size : 4096; size < params->len + len; size *= 2)
+            ;
+        if ((newdata = realloc(params->data, size)) == NULL) {
+            params->error = 1;
+            return;
+        }
+        params->data = newdata;
+        params->size = size;
+    }
+    memcpy(params->data + params->len, data, len);
+    params->len += len;
 }
 
 /* -----------------------------------------------------------------------------
 ----------------------------------------------------------------------------- */
 static 
-void writedataparam(int fd, char *param, void *data, int len)
+void appendrecord(struct pppd_params *params, u_int8_t type, const void *data, u_int32_t len)
 {
-    
-    writeintparam(fd, param, len);
-    write(fd, data, len);
-    write(fd, " ", 1);
+    appendparams(params, &type, sizeof(type));
+    appendparams(params, &len, sizeof(len));
+    appendparams(params, data, len);
 }
 
 /* -----------------------------------------------------------------------------
 ----------------------------------------------------------------------------- */
 static 
-void writestrparam(int fd, char *param, char *val)
+void initparams(struct pppd_params *params)
 {
-    
-    write(fd, param, strlen(param));
+    const char	*header = "[OPTIONS] " CONTROLLER_TLV_TAG " ";
+    u_int32_t	len = 0;
 
-    /* we need to quote and escape the parameter */
-    write(fd, " \"", 2);
-    while (*val) {
-        switch (*val) {
-            case '\\':
-            case '\"':
-				write(fd, "\\", 1);
-				break;
-            case '\'':
-            case ' ':
-                //write(fd, "\\", 1);
-                ;
+    bzero(params, sizeof(*params));
+    appendparams(params, header, strlen(header));
+    appendparams(params, &len, sizeof(len));
+    params->block = params->len;
+}
+
+/* -----------------------------------------------------------------------------
+patch the block length, and write everything to pppd
+----------------------------------------------------------------------------- */
+static 
+int sendparams(int fd, struct pppd_params *params)
+{
+    u_int32_t	len = (u_int32_t)(params->len - params->block);
+    size_t	done = 0;
+    ssize_t	n;
+
+    appendparams(params, "[EOP] ", 6);
+    if (params->error) {
+        free(params->data);
+        return -1;
+    }
+    memcpy(params->data + params->block - sizeof(len), &len, sizeof(len));
+
+    while (done < params->len) {
+        n = write(fd, params->data + done, params->len - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
         }
-        write(fd, val, 1);
-        val++;
+        done += n;
     }
-    write(fd, "\" ", 2);
+
+    free(params->data);
+    return (done == params->len) ? 0 : -1;
+}
+
+/* -----------------------------------------------------------------------------
+----------------------------------------------------------------------------- */
+static 
+void addwordparam(struct pppd_params *params, char *param)
+{
+    appendrecord(params, CONTROLLER_TLV_WORD, param, (u_int32_t)strlen(param));
+}
+
+/* -----------------------------------------------------------------------------
+----------------------------------------------------------------------------- */
+static 
+void addintparam(struct pppd_params *params, char *param, u_int32_t val)
+{
+    u_char	str[32];
+
+    addwordparam(params, param);
+    snprintf((char*)str, sizeof(str), "%d", val);
+    addwordparam(params, (char*)str);
+}
+
+/* -----------------------------------------------------------------------------
+----------------------------------------------------------------------------- */
+static 
+void adddataparam(struct pppd_params *params, char *param, void *data, int len)
+{
+
+    addintparam(params, param, len);
+    appendrecord(params, CONTROLLER_TLV_DATA, data, len);
+}
+
+/* -----------------------------------------------------------------------------
+words are sent as is, no need to quote and escape the parameter
+----------------------------------------------------------------------------- */
+static 
+void addstrparam(struct pppd_params *params, char *param, char *val)
+{
+
+    addwordparam(params, param);
+    addwordparam(params, val);
 }
 
 /* -----------------------------------------------------------------------------
@@ -727,6 +809,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
     void			*dataptr = 0;
     u_int32_t			datalen = 0;
 	u_int32_t           ccp_enabled = 0;
+    struct pppd_params		params;
 
     pppdict = CFDictionaryGetValue(service, kSCEntNetPPP);
     if ((pppdict == 0) || (CFGetTypeID(pppdict) != CFDictionaryGetTypeID()))
@@ -734,16 +817,16 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
     
     optfd = serv->u.ppp.controlfd[WRITE];
 
-    writeparam(optfd, "[OPTIONS]");
+    initparams(&params);
 
     // -----------------
     // add the dialog plugin
     if (gPluginsDir) {
         CFStringGetCString(gPluginsDir, str, sizeof(str), kCFStringEncodingUTF8);
         strlcat(str, "PPPDialogs.ppp", sizeof(str));
-        writestrparam(optfd, "plugin", str);
+        addstrparam(&params, "plugin", str);
 		if (serv->subtype == PPP_TYPE_L2TP) {
-			writeintparam(optfd, "dialogtype", 1);
+			addintparam(&params, "dialogtype", 1);
 		}
 	}
 	
@@ -751,7 +834,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
     // verbose logging 
     get_int_option(serv, kSCEntNetPPP, kSCPropNetPPPVerboseLogging, options, service, &lval, 0);
     if (lval)
-        writeparam(optfd, "debug");
+        addwordparam(&params, "debug");
 
     // -----------------
     // alert flags 
@@ -773,7 +856,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
         // debug option is different from kernel debug trace
 
         snprintf(str, sizeof(str), "%s%s", sopt[0] == '/' ? "" : DIR_LOGS, sopt);
-        writestrparam(optfd, "logfile", str);
+        addstrparam(&params, "logfile", str);
     }
 
     // -----------------
@@ -781,25 +864,25 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
     if (serv->subtypeRef) {
 		CFStringGetCString(serv->subtypeRef, str2, sizeof(str2) - 4, kCFStringEncodingUTF8);
 		strlcat(str2, ".ppp", sizeof(str2));	// add plugin suffix
-		writestrparam(optfd, "plugin", str2);
+		addstrparam(&params, "plugin", str2);
 	}
 	
     // -----------------
     // device name 
     if (ppp_getoptval(serv, options, service, PPP_OPT_DEV_NAME, sopt, sizeof(sopt), &len) && sopt[0])
-        writestrparam(optfd, "device", (char*)sopt);
+        addstrparam(&params, "device", (char*)sopt);
 
     // -----------------
     // device speed 
     if (ppp_getoptval(serv, options, service, PPP_OPT_DEV_SPEED, &lval, sizeof(lval), &len) && lval) {
         snprintf(str, sizeof(str), "%d", lval);
-        writeparam(optfd, str);
+        addwordparam(&params, str);
     }
         
     // Scoped interface
     char outgoingInterfaceString[IFXNAMSIZ];
     if (options && GetStrFromDict(options, CFSTR(NESessionStartOptionOutgoingInterface), outgoingInterfaceString, IFXNAMSIZ, "")) {
-        writestrparam(optfd, "ifscope", outgoingInterfaceString);
+        addstrparam(&params, "ifscope", outgoingInterfaceString);
     }
     
     // -----------------
@@ -866,7 +949,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 			/* serialize the modem dictionary, and pass it as a parameter */
 			if ((dataref = Serialize(modemdict, &dataptr, &datalen))) {
 
-				writedataparam(optfd, "modemdict", dataptr, datalen);
+				adddataparam(&params, "modemdict", dataptr, datalen);
 				CFRelease(dataref);
 			}
 
@@ -876,25 +959,25 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 	
             if (ppp_getoptval(ppp, options, 0, PPP_OPT_DEV_CONNECTSCRIPT, sopt, sizeof(sopt), &len) && sopt[0]) {
                 // ---------- connect script parameter ----------
-                writestrparam(optfd, "modemscript", sopt);
+                addstrparam(&params, "modemscript", sopt);
                 
                 // add all the ccl flags
                 get_int_option(ppp, kSCEntNetModem, kSCPropNetModemSpeaker, options, 0, &lval, 1);
-                writeparam(optfd, lval ? "modemsound" : "nomodemsound");
+                addwordparam(&params, lval ? "modemsound" : "nomodemsound");
         
                 get_int_option(ppp, kSCEntNetModem, kSCPropNetModemErrorCorrection, options, 0, &lval, 1);
-                writeparam(optfd, lval ? "modemreliable" : "nomodemreliable");
+                addwordparam(&params, lval ? "modemreliable" : "nomodemreliable");
     
                 get_int_option(ppp, kSCEntNetModem, kSCPropNetModemDataCompression, options, 0, &lval, 1);
-                writeparam(optfd, lval ? "modemcompress" : "nomodemcompress");
+                addwordparam(&params, lval ? "modemcompress" : "nomodemcompress");
     
                 get_int_option(ppp, kSCEntNetModem, kSCPropNetModemPulseDial, options, 0, &lval, 0);
-                writeparam(optfd, lval ? "modempulse" : "modemtone");
+                addwordparam(&params, lval ? "modempulse" : "modemtone");
         
                 // dialmode : 0 = normal, 1 = blind(ignoredialtone), 2 = manual
                 lval = 0;
                 ppp_getoptval(ppp, options, 0, PPP_OPT_DEV_DIALMODE, &lval, sizeof(lval), &len);
-                writeintparam(optfd, "modemdialmode", lval);
+                addintparam(&params, "modemdialmode", lval);
             }
 #endif
             break;
@@ -904,39 +987,39 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
             string = get_cf_option(kSCEntNetL2TP, kSCPropNetL2TPTransport, CFStringGetTypeID(), options, service, 0);
             if (string) {
                 if (CFStringCompare(string, kSCValNetL2TPTransportIP, 0) == kCFCompareEqualTo)
-                    writeparam(optfd, "l2tpnoipsec");
+                    addwordparam(&params, "l2tpnoipsec");
             }
     
 			/* check for SharedSecret keys in L2TP dictionary */
             get_str_option(serv, kSCEntNetL2TP, kSCPropNetL2TPIPSecSharedSecret, options, service, sopt, sizeof(sopt), &lval, empty_str);
             if (sopt[0]) {
-                writestrparam(optfd, "l2tpipsecsharedsecret", (char*)sopt);                        
+                addstrparam(&params, "l2tpipsecsharedsecret", (char*)sopt);                        
 
 				string = get_cf_option(kSCEntNetL2TP, kSCPropNetL2TPIPSecSharedSecretEncryption, CFStringGetTypeID(), options, service, 0);
 				if (string) {
 					if (CFStringCompare(string, CFSTR("Key"), 0) == kCFCompareEqualTo)
-						writestrparam(optfd, "l2tpipsecsharedsecrettype", "key");                        
+						addstrparam(&params, "l2tpipsecsharedsecrettype", "key");                        
 					else if (CFStringCompare(string, kSCValNetL2TPIPSecSharedSecretEncryptionKeychain, 0) == kCFCompareEqualTo)
-						writestrparam(optfd, "l2tpipsecsharedsecrettype", "keychain");                        
+						addstrparam(&params, "l2tpipsecsharedsecrettype", "keychain");                        
 				}
             } 
 			/* then check IPSec dictionary */
 			else {		
 				get_str_option(serv, kSCEntNetIPSec, kSCPropNetIPSecSharedSecret, options, service, sopt, sizeof(sopt), &lval, empty_str);
 				if (sopt[0]) {
-					writestrparam(optfd, "l2tpipsecsharedsecret", (char*)sopt);                        
+					addstrparam(&params, "l2tpipsecsharedsecret", (char*)sopt);                        
 					string = get_cf_option(kSCEntNetL2TP, kSCPropNetIPSecSharedSecretEncryption, CFStringGetTypeID(), options, service, 0);
 					if (string) {
 						if (CFStringCompare(string, CFSTR("Key"), 0) == kCFCompareEqualTo)
-							writestrparam(optfd, "l2tpipsecsharedsecrettype", "key");                        
+							addstrparam(&params, "l2tpipsecsharedsecrettype", "key");                        
 						else if (CFStringCompare(string, kSCValNetIPSecSharedSecretEncryptionKeychain, 0) == kCFCompareEqualTo)
-							writestrparam(optfd, "l2tpipsecsharedsecrettype", "keychain");                        
+							addstrparam(&params, "l2tpipsecsharedsecrettype", "keychain");                        
 					}
 				}
 			}
 			
             get_int_option(serv, kSCEntNetL2TP, CFSTR("UDPPort"), options, service, &lval, 0 /* Dynamic port */);
-            writeintparam(optfd, "l2tpudpport", lval);
+            addintparam(&params, "l2tpudpport", lval);
             break;
     }
     
@@ -948,19 +1031,19 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
          Fix me : terminal mode is only supported in PPPSerial types of connection
          but subtype using ptys can use it the same way */    
         if (lval != PPP_COMM_TERM_NONE && serv->subtype != PPP_TYPE_SERIAL)
-            writestrparam(optfd, "plugin", "PPPSerial.ppp");
+            addstrparam(&params, "plugin", "PPPSerial.ppp");
 
         if (lval == PPP_COMM_TERM_WINDOW)
-            writeparam(optfd, "terminalwindow");
+            addwordparam(&params, "terminalwindow");
         else if (lval == PPP_COMM_TERM_SCRIPT)
             if (ppp_getoptval(serv, options, service, PPP_OPT_COMM_TERMINALSCRIPT, sopt, sizeof(sopt), &len) && sopt[0])
-                writestrparam(optfd, "terminalscript", (char*)sopt);            
+                addstrparam(&params, "terminalscript", (char*)sopt);            
     }
 
     // -----------------
     // generic phone number option
     if (ppp_getoptval(serv, options, service, PPP_OPT_COMM_REMOTEADDR, sopt, sizeof(sopt), &len) && sopt[0])
-        writestrparam(optfd, "remoteaddress", (char*)sopt);
+        addstrparam(&params, "remoteaddress", (char*)sopt);
     
     // -----------------
     // redial options 
@@ -969,49 +1052,49 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
             
         get_str_option(serv, kSCEntNetPPP, kSCPropNetPPPCommAlternateRemoteAddress, options, service, sopt, sizeof(sopt), &lval, empty_str);
         if (sopt[0])
-            writestrparam(optfd, "altremoteaddress", (char*)sopt);
+            addstrparam(&params, "altremoteaddress", (char*)sopt);
         
         get_int_option(serv, kSCEntNetPPP, kSCPropNetPPPCommRedialCount, options, service, &lval, 0);
         if (lval)
-            writeintparam(optfd, "redialcount", lval);
+            addintparam(&params, "redialcount", lval);
 
         get_int_option(serv, kSCEntNetPPP, kSCPropNetPPPCommRedialInterval, options, service, &lval, 0);
         if (lval)
-            writeintparam(optfd, "redialtimer", lval);
+            addintparam(&params, "redialtimer", lval);
     }
 
 	awaketime = gSleeping ? 0 : ((mach_absolute_time() - gWakeUpTime) * gTimeScaleSeconds);
 	if (awaketime < MAX_EXTRACONNECTTIME) {
-        writeintparam(optfd, "extraconnecttime", MAX(MAX_EXTRACONNECTTIME - awaketime, MIN_EXTRACONNECTTIME));
+        addintparam(&params, "extraconnecttime", MAX(MAX_EXTRACONNECTTIME - awaketime, MIN_EXTRACONNECTTIME));
 	}
 	
 	// -----------------
     // idle options 
     if (ppp_getoptval(serv, options, service, PPP_OPT_COMM_IDLETIMER, &lval, sizeof(lval), &len) && lval) {
-        writeintparam(optfd, "idle", lval);
-        writeparam(optfd, "noidlerecv");
+        addintparam(&params, "idle", lval);
+        addwordparam(&params, "noidlerecv");
     }
 
     // -----------------
     // connection time option 
     if (ppp_getoptval(serv, options, service, PPP_OPT_COMM_SESSIONTIMER, &lval, sizeof(lval), &len) && lval)
-        writeintparam(optfd, "maxconnect", lval);
+        addintparam(&params, "maxconnect", lval);
     
     // -----------------
     // dial on demand options 
     if (onTraffic) {
-        writeparam(optfd, "demand");
+        addwordparam(&params, "demand");
         get_int_option(serv, kSCEntNetPPP, CFSTR("HoldOffTime"), 0, service, &lval, 30);
-        writeintparam(optfd, "holdoff", lval);
+        addintparam(&params, "holdoff", lval);
 		if ((onTraffic & 0x2) && lval)
-			writeparam(optfd, "holdfirst");
+			addwordparam(&params, "holdfirst");
         get_int_option(serv, kSCEntNetPPP, CFSTR("MaxFailure"), 0, service, &lval, 3);
-        writeintparam(optfd, "maxfail", lval);
+        addintparam(&params, "maxfail", lval);
     } else {
 #if TARGET_OS_OSX
         // if reconnecting, add option to wait for successful resolver
         if (serv->persist_connect) {
-            writeintparam(optfd, "retrylinkcheck", 10);
+            addintparam(&params, "retrylinkcheck", 10);
         }
 #endif
     }
@@ -1022,46 +1105,46 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
     // echo option is 2 bytes for interval + 2 bytes for failure
     if (ppp_getoptval(serv, options, service, PPP_OPT_LCP_ECHO, &lval, sizeof(lval), &len) && lval) {
         if (lval >> 16)
-            writeintparam(optfd, "lcp-echo-interval", lval >> 16);
+            addintparam(&params, "lcp-echo-interval", lval >> 16);
 
         if (lval & 0xffff)
-            writeintparam(optfd, "lcp-echo-failure", lval & 0xffff);
+            addintparam(&params, "lcp-echo-failure", lval & 0xffff);
     }
     
     // -----------------
     // address and protocol field compression options 
     if (ppp_getoptval(serv, options, service, PPP_OPT_LCP_HDRCOMP, &lval, sizeof(lval), &len)) {
         if (!(lval & 1))
-            writeparam(optfd, "nopcomp");
+            addwordparam(&params, "nopcomp");
         if (!(lval & 2))
-            writeparam(optfd, "noaccomp");
+            addwordparam(&params, "noaccomp");
     }
 
     // -----------------
     // mru option 
     if (ppp_getoptval(serv, options, service, PPP_OPT_LCP_MRU, &lval, sizeof(lval), &len) && lval)
-        writeintparam(optfd, "mru", lval);
+        addintparam(&params, "mru", lval);
 
     // -----------------
     // mtu option 
     if (ppp_getoptval(serv, options, service, PPP_OPT_LCP_MTU, &lval, sizeof(lval), &len) && lval)
-        writeintparam(optfd, "mtu", lval);
+        addintparam(&params, "mtu", lval);
 
     // -----------------
     // receive async map option 
     if (ppp_getoptval(serv, options, service, PPP_OPT_LCP_RCACCM, &lval, sizeof(lval), &len)) {
         if (lval)
-			writeintparam(optfd, "asyncmap", lval);
+			addintparam(&params, "asyncmap", lval);
 		else 
-			writeparam(optfd, "receive-all");
+			addwordparam(&params, "receive-all");
 	} 
 	else 
-		writeparam(optfd, "default-asyncmap");
+		addwordparam(&params, "default-asyncmap");
 
     // -----------------
     // send async map option 
      if (ppp_getoptval(serv, options, service, PPP_OPT_LCP_TXACCM, &lval, sizeof(lval), &len) && lval) {
-            writeparam(optfd, "escape");
+            addwordparam(&params, "escape");
             str[0] = 0;
             for (lval1 = 0; lval1 < 32; lval1++) {
                 if ((lval >> lval1) & 1) {
@@ -1070,13 +1153,13 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
                }
             }
             str[strlen(str)-1] = 0; // remove last ','
-            writeparam(optfd, str);
+            addwordparam(&params, str);
        }
 
     // -----------------
     // ipcp options 
 	if (!CFDictionaryContainsKey(service, kSCEntNetIPv4)) {
-        writeparam(optfd, "noip");
+        addwordparam(&params, "noip");
     }
     else {
     
@@ -1084,24 +1167,24 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
         // set ip param to be the router address 
         if (getStringFromEntity(gDynamicStore, kSCDynamicStoreDomainState, 0, 
             kSCEntNetIPv4, kSCPropNetIPv4Router, sopt, OPT_STR_LEN) && sopt[0])
-            writestrparam(optfd, "ipparam", (char*)sopt);
+            addstrparam(&params, "ipparam", (char*)sopt);
         
         // OverridePrimary option not handled yet in Setup by IPMonitor
         get_int_option(serv, kSCEntNetIPv4, kSCPropNetOverridePrimary, 0 /* don't look in options */, service, &lval, 0);
         if (lval) {
 			overrideprimary = 1;
-            writeparam(optfd, "defaultroute");
+            addwordparam(&params, "defaultroute");
 		}
     
         // -----------------
         // vj compression option 
         if (! (ppp_getoptval(serv, options, service, PPP_OPT_IPCP_HDRCOMP, &lval, sizeof(lval), &len) && lval))
-            writeparam(optfd, "novj");
+            addwordparam(&params, "novj");
     
         // -----------------
         // XXX  enforce the source address
         if (serv->subtype == PPP_TYPE_L2TP) {
-            writeintparam(optfd, "ip-src-address-filter", 2);
+            addintparam(&params, "ip-src-address-filter", 2);
         }
         
         // -----------------
@@ -1118,11 +1201,11 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
         else 
             strlcpy(str2, "0", sizeof(str2));
         strlcat(str, str2, sizeof(str));
-        writeparam(optfd, str);
+        addwordparam(&params, str);
     
-        writeparam(optfd, "noipdefault");
-        writeparam(optfd, "ipcp-accept-local");
-        writeparam(optfd, "ipcp-accept-remote");
+        addwordparam(&params, "noipdefault");
+        addwordparam(&params, "ipcp-accept-local");
+        addwordparam(&params, "ipcp-accept-remote");
     
 
     /* ************************************************************************* */
@@ -1130,7 +1213,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
         // usepeerdns option
 		get_int_option(serv, kSCEntNetPPP, CFSTR("IPCPUsePeerDNS"), options, service, &lval, 1);
         if (lval)
-            writeparam(optfd, "usepeerdns");
+            addwordparam(&params, "usepeerdns");
 
 		// usepeerwins if a SMB dictionary is present
 		// but make sure it is not disabled in PPP
@@ -1138,7 +1221,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 		if (CFDictionaryContainsKey(service, kSCEntNetSMB)) {
 			get_int_option(serv, kSCEntNetPPP, CFSTR("IPCPUsePeerWINS"), options, service, &lval, 1);
 			if (lval)
-				writeparam(optfd, "usepeerwins");
+				addwordparam(&params, "usepeerwins");
 		}
 #endif
 		
@@ -1147,7 +1230,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 		
 		switch (serv->subtype) {
 			case PPP_TYPE_L2TP:
-				writeparam(optfd, "addifroute");				
+				addwordparam(&params, "addifroute");				
 				break;
 				
 			default:
@@ -1161,8 +1244,8 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
         // ipv6 is not started by default
     }
     else {
-        writeparam(optfd, "+ipv6");
-        writeparam(optfd, "ipv6cp-use-persistent");
+        addwordparam(&params, "+ipv6");
+        addwordparam(&params, "ipv6cp-use-persistent");
     }
 
 	// -----------------
@@ -1170,26 +1253,26 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 
 	if (overrideprimary) {
 		// acsp and dhcp not need when all traffic is sent over PPP
-		writeparam(optfd, "noacsp"); 
-		writeparam(optfd, "no-use-dhcp"); 
+		addwordparam(&params, "noacsp"); 
+		addwordparam(&params, "no-use-dhcp"); 
 	}
 	else {
 		// acsp options
 		get_int_option(serv, kSCEntNetPPP, kSCPropNetPPPACSPEnabled, options, service, &lval, 0);
 		if (lval == 0)
-			writeparam(optfd, "noacsp");
+			addwordparam(&params, "noacsp");
 		
 		// dhcp is on by default for vpn, and off for everything else 
 		get_int_option(serv, kSCEntNetPPP, CFSTR("UseDHCP"), options, service, &lval,  (serv->subtype == PPP_TYPE_L2TP) ? 1 : 0);
 		if (lval == 1)
-			writeparam(optfd, "use-dhcp");
+			addwordparam(&params, "use-dhcp");
 	}
 
     // -----------------
     // authentication options 
 
     // don't want authentication on our side...
-    writeparam(optfd, "noauth");
+    addwordparam(&params, "noauth");
 
      if (ppp_getoptval(serv, options, service, PPP_OPT_AUTH_PROTO, &lval, sizeof(lval), &len) && (lval != PPP_AUTH_NONE)) {
 
@@ -1198,7 +1281,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 		if (ppp_getoptval(serv, options, service, PPP_OPT_AUTH_NAME, sopt, sizeof(sopt), &len) && sopt[0]) {
 
 
-            writestrparam(optfd, "user", (char*)sopt);
+            addstrparam(&params, "user", (char*)sopt);
 			needpasswd = 1;
 
             lval1 = get_str_option(serv, kSCEntNetPPP, kSCPropNetPPPAuthPassword, options, service, sopt, sizeof(sopt), &lval, empty_str);
@@ -1209,10 +1292,10 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 					(lval1 == 3) ? NULL : options, (lval1 == 3) ? service : NULL , NULL);
 
 				if (encryption && (CFStringCompare(encryption, kSCValNetPPPAuthPasswordEncryptionKeychain, 0) == kCFCompareEqualTo)) {
-					writestrparam(optfd, (lval1 == 3) ? "keychainpassword" : "userkeychainpassword", (char*)sopt);
+					addstrparam(&params, (lval1 == 3) ? "keychainpassword" : "userkeychainpassword", (char*)sopt);
 				}
 				else if (encryption && (CFStringCompare(encryption, kSCValNetPPPAuthPasswordEncryptionToken, 0) == kCFCompareEqualTo)) {
-					writeintparam(optfd, "tokencard", 1);
+					addintparam(&params, "tokencard", 1);
 					tokendone = 1;
 				}
 				else {
@@ -1221,13 +1304,13 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 						CFStringGetCString(aString, (char*)sopt, OPT_STR_LEN, kCFStringEncodingWindowsLatin1);
 						CFRelease(aString);
 					}
-					writestrparam(optfd, "password", (char*)sopt);
+					addstrparam(&params, "password", (char*)sopt);
 				}
             }
             else { 
 				encryption = get_cf_option(kSCEntNetPPP, kSCPropNetPPPAuthPasswordEncryption, CFStringGetTypeID(), options, service, NULL);
 				if (encryption && (CFStringCompare(encryption, kSCValNetPPPAuthPasswordEncryptionToken, 0) == kCFCompareEqualTo)) {
-					writeintparam(optfd, "tokencard", 1);
+					addintparam(&params, "tokencard", 1);
 					tokendone = 1;
 				}
             }
@@ -1235,7 +1318,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 		else {
 			encryption = get_cf_option(kSCEntNetPPP, kSCPropNetPPPAuthPasswordEncryption, CFStringGetTypeID(), options, service, NULL);
 			if (encryption && (CFStringCompare(encryption, kSCValNetPPPAuthPasswordEncryptionToken, 0) == kCFCompareEqualTo)) {
-				writeintparam(optfd, "tokencard", 1);
+				addintparam(&params, "tokencard", 1);
 				tokendone = 1;
 				needpasswd = 1;
 			}
@@ -1285,7 +1368,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 		// authentication variation for token card support...
 		get_int_option(serv, kSCEntNetPPP, CFSTR("TokenCard"), options, service, &lval, 0);
 		if (lval) {
-			writeintparam(optfd, "tokencard", lval);
+			addintparam(&params, "tokencard", lval);
 			needpasswd = 1;
 		}
 	}
@@ -1314,7 +1397,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
                     // for user options, we only accept plugin in the EAP directory (/System/Library/SystemConfiguration/PPPController.bundle/Contents/PlugIns)
                     if (from_service || strchr(str, '\\') == 0) {
                         strlcat(str, ".ppp", sizeof(str));	// add plugin suffix
-                        writestrparam(optfd, "eapplugin", str);
+                        addstrparam(&params, "eapplugin", str);
                         auth_bits |= 0x10; // confirm EAP flag
                     }
                 }
@@ -1337,11 +1420,11 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
         // if the CCPAccepted and CCPRequired array are not there, 
         // assume we accept all types of compression we support
 
-        writeparam(optfd, "mppe-stateless");
+        addwordparam(&params, "mppe-stateless");
 		get_int_option(serv, kSCEntNetPPP, CFSTR("CCPMPPE128Enabled"), options, service, &lval, 1);
-		writeparam(optfd, lval ? "mppe-128" : "nomppe-128");        
+		addwordparam(&params, lval ? "mppe-128" : "nomppe-128");        
 		get_int_option(serv, kSCEntNetPPP, CFSTR("CCPMPPE40Enabled"), options, service, &lval, 1);
-        writeparam(optfd, lval ? "mppe-40" : "nomppe-40");        
+        addwordparam(&params, lval ? "mppe-40" : "nomppe-40");        
 
         // No authentication specified, also enforce the use of MS-CHAP
         if (auth_default)
@@ -1349,20 +1432,20 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
     }
     else {
         // no compression protocol
-        writeparam(optfd, "noccp");	
+        addwordparam(&params, "noccp");	
     }
     
     // set authentication protocols parameters
     if ((auth_bits & 1) == 0)
-        writeparam(optfd, "refuse-pap");
+        addwordparam(&params, "refuse-pap");
     if ((auth_bits & 2) == 0)
-        writeparam(optfd, "refuse-chap-md5");
+        addwordparam(&params, "refuse-chap-md5");
     if ((auth_bits & 4) == 0)
-        writeparam(optfd, "refuse-mschap");
+        addwordparam(&params, "refuse-mschap");
     if ((auth_bits & 8) == 0)
-        writeparam(optfd, "refuse-mschap-v2");
+        addwordparam(&params, "refuse-mschap-v2");
     if ((auth_bits & 0x10) == 0)
-        writeparam(optfd, "refuse-eap");
+        addwordparam(&params, "refuse-eap");
         
     // if EAP is the only method, pppd doesn't need to ask for the password
     // let the EAP plugin handle that.
@@ -1372,26 +1455,26 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
 
     // loop local traffic destined to the local ip address
     // Radar #3124639.
-    //writeparam(optfd, "looplocal");       
+    //addwordparam(&params, "looplocal");       
 
 #if TARGET_OS_OSX
     if (!(serv->flags & FLAG_ALERTPASSWORDS) || !needpasswd || serv->flags & FLAG_DARKWAKE)
 #else
     if (!(serv->flags & FLAG_ALERTPASSWORDS) || !needpasswd)
 #endif
-        writeparam(optfd, "noaskpassword");
+        addwordparam(&params, "noaskpassword");
 
     get_str_option(serv, kSCEntNetPPP, kSCPropNetPPPAuthPrompt, options, service, sopt, sizeof(sopt), &lval, empty_str);
     if (sopt[0]) {
         str2[0] = 0;
         CFStringGetCString(kSCValNetPPPAuthPromptAfter, str2, sizeof(str2), kCFStringEncodingUTF8);
         if (!strcmp((char *)sopt, str2))
-            writeparam(optfd, "askpasswordafter");
+            addwordparam(&params, "askpasswordafter");
     }
     
     // -----------------
     // no need for pppd to detach.
-    writeparam(optfd, "nodetach");
+    addwordparam(&params, "nodetach");
 
     // -----------------
     // reminder option must be specified after PPPDialogs plugin option
@@ -1399,7 +1482,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
     if (lval) {
         get_int_option(serv, kSCEntNetPPP, kSCPropNetPPPIdleReminderTimer, options, service, &lval, 0);
         if (lval)
-            writeintparam(optfd, "reminder", lval);
+            addintparam(&params, "reminder", lval);
     }
 
     // -----------------
@@ -1412,7 +1495,7 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
             if (string && (CFGetTypeID(string) == CFStringGetTypeID())) {
                 CFStringGetCString(string, str, sizeof(str) - 4, kCFStringEncodingUTF8);
                 strlcat(str, ".ppp", sizeof(str));	// add plugin suffix
-                writestrparam(optfd, "plugin", str);
+                addstrparam(&params, "plugin", str);
             }
         }
     }
@@ -1423,11 +1506,9 @@ int send_pppd_params(struct service *serv, CFDictionaryRef service, CFDictionary
     // look first in ppp dictionary, then in service
 	if (GetStrFromDict(pppdict, kSCPropUserDefinedName, (char*)sopt, OPT_STR_LEN, empty_str_s)
 		|| GetStrFromDict(service, kSCPropUserDefinedName, (char*)sopt, OPT_STR_LEN, empty_str_s)) 
-        writestrparam(optfd, "call", (char*)sopt);
+        addstrparam(&params, "call", (char*)sopt);
 	
-    writeparam(optfd, "[EOP]");
-
-    return 0;
+    return sendparams(optfd, &params);
 }
 
 /* -----------------------------------------------------------------------------
@@ -1438,6 +1519,7 @@ int change_pppd_params(struct service *serv, CFDictionaryRef service, CFDictiona
     int 			optfd;
     u_int32_t			lval, len;
     CFDictionaryRef		pppdict = NULL;
+    struct pppd_params		params;
 
     pppdict = CFDictionaryGetValue(service, kSCEntNetPPP);
     if ((pppdict == 0) || (CFGetTypeID(pppdict) != CFDictionaryGetTypeID()))
@@ -1445,28 +1527,26 @@ int change_pppd_params(struct service *serv, CFDictionaryRef service, CFDictiona
     
     optfd = serv->u.ppp.controlfd[WRITE];
 
-    writeparam(optfd, "[OPTIONS]");
+    initparams(&params);
 
     // -----------------
     // reminder option must be specified after PPPDialogs plugin option
     get_int_option(serv, kSCEntNetPPP, kSCPropNetPPPIdleReminder, options, service, &lval, 0);
     if (lval)
         get_int_option(serv, kSCEntNetPPP, kSCPropNetPPPIdleReminderTimer, options, service, &lval, 0);
-    writeintparam(optfd, "reminder", lval);
+    addintparam(&params, "reminder", lval);
 
     // -----------------
     ppp_getoptval(serv, options, service, PPP_OPT_COMM_IDLETIMER, &lval, sizeof(lval), &len);
-    writeintparam(optfd, "idle", lval);
+    addintparam(&params, "idle", lval);
 
     // Scoped interface
     char outgoingInterfaceString[IFXNAMSIZ];
     if (options && GetStrFromDict(options, CFSTR(NESessionStartOptionOutgoingInterface), outgoingInterfaceString, IFXNAMSIZ, "")) {
-        writestrparam(optfd, "ifscope", outgoingInterfaceString);
+        addstrparam(&params, "ifscope", outgoingInterfaceString);
     }
 		
-    writeparam(optfd, "[EOP]");
-
-    return 0;
+    return sendparams(optfd, &params);
 }
 
 int ppp_install(struct service *serv)
@@ -66,7 +66,7 @@ Definitions
 #define ABS(a) 			(a >= 0 ? a : -a)
 
 struct l2tp_elem {
-    TAILQ_ENTRY(l2tp_elem)	next;
+    TAILQ_ENTRY(l2tp_elem)	next;			/* link in a rfc queue, or in the free list */
     mbuf_t 		packet;
     u_int16_t			seqno;
     u_int8_t			addr[INET6_ADDRSTRLEN]; /* use the largest address between v4 and v6 */
@@ -106,6 +106,7 @@ struct l2tp_rfc {
     u_int16_t		peer_nr;			/* last seq number peer acked */
     u_int16_t		our_last_data_seq;		/* last data seq number we sent */
     u_int16_t		peer_last_data_seq;		/* last data seq number we received */
+    struct l2tp_header	ack_hdr;			/* pre-built ZLB ack header, only ns and nr change */
     TAILQ_HEAD(, l2tp_elem) send_queue;		/* control message send queue */
     TAILQ_HEAD(, l2tp_elem) recv_queue;		/* control or sequenced data message recv queue */
 
@@ -115,22 +116,71 @@ struct l2tp_rfc {
     if (rfc->flags & L2TP_FLAG_DEBUG)   \
         IOLog(str, args)
 
+/*
+ * control queue elements are recycled through a free list, to avoid going
+ * to the allocator for every control message and every ack.
+ * the free list is protected by ppp_domain_mutex, like the rfc queues.
+ */
+#define L2TP_ELEM_FREE_MAX	256		/* max number of elements kept in the free list */
+
+static TAILQ_HEAD(, l2tp_elem) l2tp_elem_free_list = TAILQ_HEAD_INITIALIZER(l2tp_elem_free_list);
+static int l2tp_elem_free_count = 0;
+
+static struct l2tp_elem *
+l2tp_elem_get_free(void)
+{
+	struct l2tp_elem *elem;
+
+	elem = TAILQ_FIRST(&l2tp_elem_free_list);
+	if (elem) {
+		TAILQ_REMOVE(&l2tp_elem_free_list, elem, next);
+		l2tp_elem_free_count--;
+		bzero(elem, sizeof(*elem));
+	}
+	return elem;
+}
+
 static struct l2tp_elem *
 l2tp_elem_alloc(void)
 {
+	struct l2tp_elem *elem = l2tp_elem_get_free();
+
+	if (elem)
+		return elem;
 	return kalloc_type(struct l2tp_elem, Z_WAITOK | Z_ZERO | Z_NOFAIL);
 }
 
 static struct l2tp_elem *
 l2tp_elem_alloc_noblock(void)
 {
+	struct l2tp_elem *elem = l2tp_elem_get_free();
+
+	if (elem)
+		return elem;
 	return kalloc_type(struct l2tp_elem, Z_NOWAIT | Z_ZERO);
 }
 
 static void
 l2tp_elem_free(struct l2tp_elem *elem)
 {
-	return kfree_type(struct l2tp_elem, elem);
+	if (l2tp_elem_free_count < L2TP_ELEM_FREE_MAX) {
+		TAILQ_INSERT_HEAD(&l2tp_elem_free_list, elem, next);
+		l2tp_elem_free_count++;
+		return;
+	}
+	kfree_type(struct l2tp_elem, elem);
+}
+
+static void
+l2tp_elem_free_list_dispose(void)
+{
+	struct l2tp_elem *elem;
+
+	while ((elem = TAILQ_FIRST(&l2tp_elem_free_list))) {
+		TAILQ_REMOVE(&l2tp_elem_free_list, elem, next);
+		kfree_type(struct l2tp_elem, elem);
+	}
+	l2tp_elem_free_count = 0;
 }
 
 
@@ -215,6 +265,8 @@ u_int16_t l2tp_rfc_dispose()
 
     if (l2tp_udp_dispose())
         return 1;
+
+	l2tp_elem_free_list_dispose();
     return 0;
 }
 
@@ -421,6 +473,12 @@ u_int16_t l2tp_rfc_command(void *data, u_int32_t cmd, void *cmddata)
         case L2TP_CMD_SETPEERTUNNELID:
             LOGIT(rfc, "L2TP command (%p): set peer tunnel id = 0x%x\n", rfc, *(u_int16_t *)cmddata);
             rfc->peer_tunnel_id = *(u_int16_t *)cmddata;
+
+            /* prepare the ZLB ack header, only sequence numbers will need to be filled */
+            bzero(&rfc->ack_hdr, sizeof(rfc->ack_hdr));
+            rfc->ack_hdr.flags_vers = htons(L2TP_FLAGS_L | L2TP_FLAGS_T | L2TP_FLAGS_S | L2TP_HDR_VERSION);
+            rfc->ack_hdr.len = htons(L2TP_CNTL_HDR_SIZE);
+            rfc->ack_hdr.tunnel_id = htons(rfc->peer_tunnel_id);
             break;
 
         case L2TP_CMD_SETSESSIONID:
@@ -617,7 +675,6 @@ u_int16_t l2tp_rfc_command(void *data, u_int32_t cmd, void *cmddata)
 static void l2tp_rfc_delayed_ack(struct l2tp_rfc *rfc)
 {
     mbuf_t				m;
-    struct l2tp_header 	*hdr, hdr_data;
     
 	if ((rfc->state & L2TP_STATE_NEW_SEQUENCE) && rfc->peer_tunnel_id) {
 			
@@ -626,19 +683,13 @@ static void l2tp_rfc_delayed_ack(struct l2tp_rfc *rfc)
 			
 		mbuf_setlen(m, L2TP_CNTL_HDR_SIZE);
 		mbuf_pkthdr_setlen(m, L2TP_CNTL_HDR_SIZE);
-		hdr = &hdr_data;
-		bzero(hdr, L2TP_CNTL_HDR_SIZE);
-
-		hdr->flags_vers = htons(L2TP_FLAGS_L | L2TP_FLAGS_T | L2TP_FLAGS_S | L2TP_HDR_VERSION); 
-		hdr->len = htons(L2TP_CNTL_HDR_SIZE); 
 
-		hdr->ns = htons(rfc->our_ns);
-		hdr->nr = htons(rfc->our_nr);
-		hdr->tunnel_id = htons(rfc->peer_tunnel_id);
-		hdr->session_id = 0;
+		/* header was prepared when the peer tunnel id was set */
+		rfc->ack_hdr.ns = htons(rfc->our_ns);
+		rfc->ack_hdr.nr = htons(rfc->our_nr);
 		rfc->state &= ~L2TP_STATE_NEW_SEQUENCE;
 
-		memcpy(mbuf_data(m), hdr, L2TP_CNTL_HDR_SIZE);
+		memcpy(mbuf_data(m), &rfc->ack_hdr, L2TP_CNTL_HDR_SIZE);
 
 		l2tp_udp_output(rfc->socket, rfc->thread, m, (struct sockaddr *)rfc->peer_address);
 	}
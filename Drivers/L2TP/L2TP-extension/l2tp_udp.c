@@ -65,6 +65,7 @@ struct l2tp_udp_thread {
 
 #define L2TP_UDP_MAX_THREADS 16
 #define L2TP_UDP_DEF_OUTQ_SIZE 1024
+#define L2TP_UDP_INPUT_BATCH 16		/* max packets processed per acquisition of ppp_domain_mutex */
 
 void	l2tp_ip_input(mbuf_t , int len);
 void l2tp_udp_thread_func(struct l2tp_udp_thread *thread_socket);
@@ -301,32 +302,43 @@ void l2tp_udp_dispose_threads()
 
 /* -----------------------------------------------------------------------------
 callback from udp
+packets are read from the socket in batches of up to L2TP_UDP_INPUT_BATCH,
+and each batch is processed under a single acquisition of ppp_domain_mutex
 ----------------------------------------------------------------------------- */
 void l2tp_udp_input(socket_t so, void *arg, int waitflag)
 {
-    mbuf_t mp = 0;
-	size_t recvlen = 1000000000;
-    struct sockaddr_in6 from;
+    mbuf_t mp[L2TP_UDP_INPUT_BATCH];
+	size_t recvlen;
+    struct sockaddr_in6 from[L2TP_UDP_INPUT_BATCH];
     struct msghdr msg;
+	int i, n;
 
     do {
     
-		bzero(&from, sizeof(from));
-		bzero(&msg, sizeof(msg));
-		msg.msg_namelen = sizeof(from);
-		msg.msg_name = &from;
-	
-		if (sock_receivembuf(so, &msg, &mp, MSG_DONTWAIT, &recvlen) != 0)
-			break;
+		for (n = 0; n < L2TP_UDP_INPUT_BATCH; n++) {
+
+			bzero(&from[n], sizeof(from[n]));
+			bzero(&msg, sizeof(msg));
+			msg.msg_namelen = sizeof(from[n]);
+			msg.msg_name = &from[n];
+			
+			// recvlen is updated with the received length, reset it for each packet
+			recvlen = 1000000000;
+			mp[n] = 0;
+			if (sock_receivembuf(so, &msg, &mp[n], MSG_DONTWAIT, &recvlen) != 0
+				|| mp[n] == 0)
+				break;
+		}
 
-        if (mp == 0) 
-            break;
+		if (n == 0)
+			break;
 
 		lck_mtx_lock(ppp_domain_mutex);
-		l2tp_rfc_lower_input(so, mp, (struct sockaddr *)&from);
+		for (i = 0; i < n; i++)
+			l2tp_rfc_lower_input(so, mp[i], (struct sockaddr *)&from[i]);
 		lck_mtx_unlock(ppp_domain_mutex);
 		
-    } while (1);
+    } while (n == L2TP_UDP_INPUT_BATCH);
 
 }
 
@@ -2219,6 +2219,7 @@ void l2tp_close_fds()
         hello_timer_running = 0;
     }
     if (eventsockfd != -1) {
+        remove_fd(eventsockfd);
         close(eventsockfd);
         eventsockfd = -1;
     }
@@ -2227,6 +2228,7 @@ void l2tp_close_fds()
         datasockfd = -1;
     }
     if (ctrlsockfd >= 0) {
+        remove_fd(ctrlsockfd);
         close(ctrlsockfd);
         ctrlsockfd = -1;
     }
@@ -60,6 +60,7 @@ struct sockaddr_pppoe
 #define PPPOE_OPT_RING_TIMER	4	/* time allowed for incoming call (in seconds) */
 #define PPPOE_OPT_RETRY_TIMER	5	/* connection retry timer (in seconds) */
 #define PPPOE_OPT_PEER_ENETADDR	6	/* peer ethernet address */
+#define PPPOE_OPT_MAX_PAYLOAD	7	/* PPP-Max-Payload, RFC 4638 (set: requested, get: negotiated) */
 
 /* flags definition */
 #define PPPOE_FLAG_LOOPBACK	0x00000001	/* loopback mode, for debugging purpose */
@@ -325,3 +325,15 @@ int pppoe_dlil_output(ifnet_t ifp, mbuf_t m, u_int8_t *to, u_int16_t typ)
     return 0;
 }
 
+/* -----------------------------------------------------------------------------
+called from pppenet_proto when data need to be sent, with the ethernet header
+already in place. m can be a chain of packets, handed to the interface at once
+----------------------------------------------------------------------------- */
+int pppoe_dlil_output_raw(ifnet_t ifp, mbuf_t m)
+{
+
+	lck_mtx_unlock(ppp_domain_mutex);
+    ifnet_output_raw(ifp, PF_PPP, m);
+	lck_mtx_lock(ppp_domain_mutex);
+    return 0;
+}
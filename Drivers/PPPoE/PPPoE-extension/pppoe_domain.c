@@ -53,6 +53,10 @@
 Definitions
 ----------------------------------------------------------------------------- */
 
+#if TARGET_OS_OSX
+SYSCTL_NODE(_net_ppp, OID_AUTO, pppoe, CTLFLAG_RW, 0, "");
+#endif
+
 
 /* -----------------------------------------------------------------------------
 Forward declarations
@@ -133,6 +137,9 @@ int pppoe_domain_init(int init_arg)
     }
 
     pppoe_wan_init();
+#if TARGET_OS_OSX
+    sysctl_register_oid(&sysctl__net_ppp_pppoe);
+#endif
 
     pppoe_domain_inited = 1;
 
@@ -181,6 +188,10 @@ int pppoe_domain_terminate(int term_arg)
         goto end;
     }
 
+#if TARGET_OS_OSX
+    sysctl_unregister_oid(&sysctl__net_ppp_pppoe);
+#endif
+
     pppoe_domain_inited = 0;
 
 end:
@@ -288,6 +288,14 @@ int pppoe_ctloutput(struct socket *so, struct sockopt *sopt)
                     else if ((error = sooptcopyin(sopt, &str, 2, 2)) == 0)
                         pppoe_rfc_command(so->so_pcb, PPPOE_CMD_SETPEERADDR , &str);
                     break;
+                case PPPOE_OPT_MAX_PAYLOAD:
+                    if (sopt->sopt_valsize != 2)
+                        error = EMSGSIZE;
+                    else if ((error = sooptcopyin(sopt, &val, 2, 2)) == 0) {
+                        if (pppoe_rfc_command(so->so_pcb, PPPOE_CMD_SETMAXPAYLOAD, &val))
+                            error = EISCONN;
+                    }
+                    break;
                 default:
                     error = ENOPROTOOPT;
             }
@@ -345,6 +353,14 @@ int pppoe_ctloutput(struct socket *so, struct sockopt *sopt)
                         error = sooptcopyout(sopt, &str, 6);
                     }
                     break;
+                case PPPOE_OPT_MAX_PAYLOAD:
+                    if (sopt->sopt_valsize != 2)
+                        error = EMSGSIZE;
+                    else {
+                        pppoe_rfc_command(so->so_pcb, PPPOE_CMD_GETMAXPAYLOAD, &val);
+                        error = sooptcopyout(sopt, &val, 2);
+                    }
+                    break;
                 default:
                     error = ENOPROTOOPT;
             }
@@ -610,9 +626,8 @@ int pppoe_send(struct socket *so, int flags, struct mbuf *m,
 
     //IOLog("pppoe_send, so = %p\n", so);
 
-    if ((error = pppoe_rfc_output(so->so_pcb, (mbuf_t)m))) {
-        mbuf_freem((mbuf_t)m);
-    }
+    // m is consumed, even on error
+    error = pppoe_rfc_output(so->so_pcb, (mbuf_t)m, NULL, NULL);
 
     return error;
 }
@@ -28,8 +28,11 @@
 #include <sys/malloc.h>
 #include <sys/syslog.h>
 #include <sys/domain.h>
+#include <sys/sysctl.h>
+#include <sys/random.h>
 #include <kern/locks.h>
 #include <net/if.h>
+#include <libkern/crypto/sha1.h>
 
 #include "../../../Family/if_ppplink.h"
 #include "../../../Family/ppp_domain.h"
@@ -60,6 +63,7 @@ Definitions
 #define PPPOE_TAG_AC_COOKIE		0x0104
 #define PPPOE_TAG_VENDOR_SPECIFIC	0x0105
 #define PPPOE_TAG_RELAY_SESSION_ID	0x0110
+#define PPPOE_TAG_PPP_MAX_PAYLOAD	0x0120
 #define PPPOE_TAG_SERVICE_NAME_ERROR	0x0201
 #define PPPOE_TAG_AC_SYSTEM_ERROR	0x0202
 #define PPPOE_TAG_GENERIC_ERROR		0x0203
@@ -77,6 +81,14 @@ Definitions
 
 #define PPPOE_TMPBUF_SIZE		1500
 
+#define PPPOE_COOKIE_LEN		16	// truncated HMAC-SHA1 over the client address
+#define PPPOE_COOKIE_SECRET_LEN		SHA1_RESULTLEN
+#define PPPOE_COOKIE_ROTATE		60	// seconds between cookie secret rotations
+
+#define PPPOE_DISCOVERY_RATE		0	// default max PADI/PADR per second, all clients (0 = no limit)
+#define PPPOE_DISCOVERY_MAC_RATE	0	// default max PADI/PADR per second, per client address (0 = no limit)
+#define PPPOE_DISCOVERY_MAC_HASH	256	// size of the per address rate table
+
 struct pppoe {
     u_int8_t ver:4;
     u_int8_t typ:4;
@@ -85,6 +97,9 @@ struct pppoe {
     u_int16_t len;
 };
 
+// ethernet header followed by the pppoe header, prepended to data packets
+#define PPPOE_DATA_HDR_LEN	(ETHER_ADDR_LEN * 2 + 2 + sizeof(struct pppoe))
+
 // a pppoe_tag is basically a buffer with information how much data it contains
 // right now, and how much space it provides in total.
 struct pppoe_tag {
@@ -130,6 +145,8 @@ struct pppoe_rfc {
 
     // administrative info
     TAILQ_ENTRY(pppoe_rfc) 	next;
+    TAILQ_ENTRY(pppoe_rfc) 	hash_next;		/* link in the session hash or in the discovery list */
+    u_int32_t			hash_index;		/* session hash bucket, or one of PPPOE_RFC_HASH_xxx */
     void 			*host; 			/* pointer back to the hosting structure */
     ifnet_t						ifp;			/* associated datalink attachment */
     pppoe_rfc_input_callback 	inputcb;		/* callback function when data are present */
@@ -161,6 +178,9 @@ struct pppoe_rfc {
     PPPOE_TAG(relay_id, PPPOE_RELAY_ID_LEN);		/* intermediate relay cookie */
     u_int16_t	session_id;				/* session id between client and server */
     u_int8_t	peer_address[ETHER_ADDR_LEN];		/* ethernet address we are connected to */
+    u_int16_t	max_payload;				/* PPP-Max-Payload we ask for, 0 if not used */
+    u_int16_t	peer_max_payload;			/* PPP-Max-Payload agreed with the peer, 0 if none */
+    u_int8_t	data_hdr[PPPOE_DATA_HDR_LEN];		/* header template for data packets, built when connected */
 
 };
 
@@ -176,6 +196,50 @@ u_int32_t 	pppoe_unique_address = 1;
 
 TAILQ_HEAD(, pppoe_rfc) 	pppoe_rfc_head;
 
+/*
+ * connected rfcs are indexed by (interface, session id, peer address) for data and PADT frames.
+ * rfcs in discovery states (looking, connecting, listening) are kept on a separate list for PADx frames.
+ */
+#define PPPOE_RFC_MAX_HASH		1024
+#define PPPOE_RFC_HASH_NONE		0xFFFFFFFF
+#define PPPOE_RFC_HASH_DISCOVERY	0xFFFFFFFE
+
+static TAILQ_HEAD(, pppoe_rfc) 	pppoe_rfc_session_hash[PPPOE_RFC_MAX_HASH];
+static TAILQ_HEAD(, pppoe_rfc) 	pppoe_rfc_discovery_head;
+
+SYSCTL_DECL(_net_ppp_pppoe);
+
+/*
+ * AC-Cookie secrets. PADO carries a cookie computed from the client address,
+ * PADR is only accepted if it returns a cookie made with the current or previous secret.
+ */
+static u_int8_t 	pppoe_cookie_secret[2][PPPOE_COOKIE_SECRET_LEN];
+static u_int16_t 	pppoe_cookie_timer = 0;
+
+/*
+ * discovery rate limiting, budgets are refilled every second by pppoe_rfc_timer.
+ * the per address budget is kept per bucket of a keyed hash of the address,
+ * the key changes every second so that colliding addresses can't be chosen.
+ */
+static u_int16_t 	pppoe_discovery_mac_table[PPPOE_DISCOVERY_MAC_HASH];
+static u_int32_t 	pppoe_discovery_mac_key;
+static int 		pppoe_discovery_rate = PPPOE_DISCOVERY_RATE;
+static int 		pppoe_discovery_mac_rate = PPPOE_DISCOVERY_MAC_RATE;
+static int 		pppoe_discovery_tokens = PPPOE_DISCOVERY_RATE;
+static int 		pppoe_discovery_dropped_rate = 0;
+static int 		pppoe_discovery_dropped_cookie = 0;
+
+#if TARGET_OS_OSX
+SYSCTL_INT(_net_ppp_pppoe, OID_AUTO, discovery_rate, CTLTYPE_INT|CTLFLAG_RW|CTLFLAG_NOAUTO|CTLFLAG_KERN,
+    &pppoe_discovery_rate, 0, "Max PADI/PADR accepted per second, 0 for no limit");
+SYSCTL_INT(_net_ppp_pppoe, OID_AUTO, discovery_mac_rate, CTLTYPE_INT|CTLFLAG_RW|CTLFLAG_NOAUTO|CTLFLAG_KERN,
+    &pppoe_discovery_mac_rate, 0, "Max PADI/PADR accepted per second from a given address, 0 for no limit");
+SYSCTL_INT(_net_ppp_pppoe, OID_AUTO, discovery_dropped_rate, CTLTYPE_INT|CTLFLAG_RD|CTLFLAG_NOAUTO|CTLFLAG_KERN,
+    &pppoe_discovery_dropped_rate, 0, "PADI/PADR dropped by rate limiting");
+SYSCTL_INT(_net_ppp_pppoe, OID_AUTO, discovery_dropped_cookie, CTLTYPE_INT|CTLFLAG_RD|CTLFLAG_NOAUTO|CTLFLAG_KERN,
+    &pppoe_discovery_dropped_cookie, 0, "PADR dropped because of a missing or invalid AC-Cookie");
+#endif
+
 extern lck_mtx_t	*ppp_domain_mutex;
 
 /* -----------------------------------------------------------------------------
@@ -190,14 +254,23 @@ static u_int16_t handle_data(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from);
 static u_int16_t handle_ctrl(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from);
 
 static void send_event(struct pppoe_rfc *rfc, u_int32_t event, u_int32_t msg);
-static void send_PAD(struct pppoe_rfc *rfc, u_int8_t *address, u_int16_t code, u_int16_t sessid,
+static void send_PAD(struct pppoe_rfc *rfc, u_int8_t *address, u_int16_t code, u_int16_t sessid, u_int16_t max_payload,
                      struct pppoe_tag *ac_name, struct pppoe_tag *service,
                      struct pppoe_tag *host_uniq, struct pppoe_tag *ac_cookie, struct pppoe_tag *relay_id);
 
 static u_int16_t add_tag(u_int8_t *data, u_int16_t tag, struct pppoe_tag *val);
 static u_int16_t get_tag(mbuf_t m, u_int16_t tag, struct pppoe_tag *val);
 
+static void make_cookie(u_int8_t *secret, ifnet_t ifp, u_int8_t *address, struct pppoe_tag *cookie);
+static u_int16_t check_cookie(ifnet_t ifp, mbuf_t m, u_int8_t *address);
+static u_int16_t check_discovery_rate(u_int8_t *address);
+static u_int16_t check_max_payload(struct pppoe_rfc *rfc, u_int16_t max_payload);
+static u_int16_t get_max_payload(mbuf_t m);
+
 u_int16_t pppoe_rfc_input(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from, u_int16_t typ);
+static void pppoe_rfc_set_state(struct pppoe_rfc *rfc, u_int16_t state);
+static void pppoe_rfc_unlink(struct pppoe_rfc *rfc);
+static void pppoe_rfc_build_data_hdr(struct pppoe_rfc *rfc);
 void pppoe_rfc_lower_output(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *to, u_int16_t typ);
 
 
@@ -208,8 +281,24 @@ need to change it to handle multiple ethernet interfaces
 u_int16_t pppoe_rfc_init()
 {
 
+    int i;
+
     pppoe_dlil_init();
     TAILQ_INIT(&pppoe_rfc_head);
+    TAILQ_INIT(&pppoe_rfc_discovery_head);
+    for (i = 0; i < PPPOE_RFC_MAX_HASH; i++)
+        TAILQ_INIT(&pppoe_rfc_session_hash[i]);
+
+    read_random(pppoe_cookie_secret[0], PPPOE_COOKIE_SECRET_LEN);
+    bcopy(pppoe_cookie_secret[0], pppoe_cookie_secret[1], PPPOE_COOKIE_SECRET_LEN);
+    read_random(&pppoe_discovery_mac_key, sizeof(pppoe_discovery_mac_key));
+
+#if TARGET_OS_OSX
+    sysctl_register_oid(&sysctl__net_ppp_pppoe_discovery_rate);
+    sysctl_register_oid(&sysctl__net_ppp_pppoe_discovery_mac_rate);
+    sysctl_register_oid(&sysctl__net_ppp_pppoe_discovery_dropped_rate);
+    sysctl_register_oid(&sysctl__net_ppp_pppoe_discovery_dropped_cookie);
+#endif
     return 0;
 }
 
@@ -222,6 +311,12 @@ u_int16_t pppoe_rfc_dispose()
     if (pppoe_dlil_dispose())
         return 1;
         
+#if TARGET_OS_OSX
+    sysctl_unregister_oid(&sysctl__net_ppp_pppoe_discovery_rate);
+    sysctl_unregister_oid(&sysctl__net_ppp_pppoe_discovery_mac_rate);
+    sysctl_unregister_oid(&sysctl__net_ppp_pppoe_discovery_dropped_rate);
+    sysctl_unregister_oid(&sysctl__net_ppp_pppoe_discovery_dropped_cookie);
+#endif
     return 0;
 }
 
@@ -249,6 +344,7 @@ u_int16_t pppoe_rfc_new_client(void *host, void **data,
     rfc->timer_retry_setup = PPPOE_TIMER_RETRY;
 
     rfc->state = PPPOE_STATE_DISCONNECTED;
+    rfc->hash_index = PPPOE_RFC_HASH_NONE;
     PPPOE_TAG_SETUP(rfc->ac_name);
     PPPOE_TAG_SETUP(rfc->service);
     PPPOE_TAG_SETUP(rfc->serv_ac_name);
@@ -283,6 +379,7 @@ void pppoe_rfc_free_client(void *data)
         if (rfc->ifp)
             pppoe_dlil_detach(rfc->ifp);
         
+        pppoe_rfc_unlink(rfc);
         TAILQ_REMOVE(&pppoe_rfc_head, rfc, next);
         kfree_type(struct pppoe_rfc, rfc);
     }
@@ -321,8 +418,9 @@ u_int16_t pppoe_rfc_connect(void *data, u_int8_t *ac_name, u_int8_t *service)
     rfc->host_uniq.len = sizeof(uintptr_t);
     rfc->ac_cookie.len = 0;
     rfc->relay_id.len = 0;
+    rfc->peer_max_payload = 0;
     
-    rfc->state = PPPOE_STATE_LOOKING;
+    pppoe_rfc_set_state(rfc, PPPOE_STATE_LOOKING);
     rfc->timer_connect = rfc->timer_connect_setup;
     // resend PADI/PADR every PPPOE_TIMEOUT_RETRY seconds
     rfc->timer_connect_resend = rfc->timer_connect - rfc->timer_retry_setup;
@@ -332,7 +430,7 @@ u_int16_t pppoe_rfc_connect(void *data, u_int8_t *ac_name, u_int8_t *service)
 
     // if ac-name specified, try to reach it, otherwise, don't use name
     // may be shoult use a '*' semantic in the address ?
-    send_PAD(rfc, rfc->peer_address, PPPOE_PADI, 0, &rfc->ac_name, &rfc->service, &rfc->host_uniq, 0, 0);
+    send_PAD(rfc, rfc->peer_address, PPPOE_PADI, 0, check_max_payload(rfc, rfc->max_payload), &rfc->ac_name, &rfc->service, &rfc->host_uniq, 0, 0);
     return 0;
 }
 
@@ -375,10 +473,10 @@ u_int16_t pppoe_rfc_accept(void *data)
     rfc->session_id = pppoe_unique_session_id++; // generate a session id
 
     // host_uniq and rfc->relay_session_id have been got from the previous PADR
-    send_PAD(rfc, rfc->peer_address, PPPOE_PADS, rfc->session_id, &rfc->ac_name, &rfc->service,
+    send_PAD(rfc, rfc->peer_address, PPPOE_PADS, rfc->session_id, rfc->peer_max_payload, &rfc->ac_name, &rfc->service,
              rfc->host_uniq.len ? &rfc->host_uniq : 0, 0, rfc->relay_id.len ? &rfc->relay_id : 0);
              
-    rfc->state = PPPOE_STATE_CONNECTED;
+    pppoe_rfc_set_state(rfc, PPPOE_STATE_CONNECTED);
     send_event(rfc, PPPOE_EVT_CONNECTED, 0);
 
     return 0;
@@ -407,7 +505,7 @@ u_int16_t pppoe_rfc_listen(void *data)
         rfc->unit = 0;
     }
 
-    rfc->state = PPPOE_STATE_LISTENING;
+    pppoe_rfc_set_state(rfc, PPPOE_STATE_LISTENING);
     
     return 0;
 }
@@ -429,7 +527,7 @@ u_int16_t pppoe_rfc_abort(void *data, int evt_enable)
         case PPPOE_STATE_CONNECTING:
         case PPPOE_STATE_LISTENING:
         case PPPOE_STATE_RINGING:
-            rfc->state = PPPOE_STATE_DISCONNECTED;
+            pppoe_rfc_set_state(rfc, PPPOE_STATE_DISCONNECTED);
             bzero(rfc->peer_address, sizeof(rfc->peer_address));
             if (evt_enable)
 				send_event(rfc, PPPOE_EVT_DISCONNECTED, 0);
@@ -461,9 +559,9 @@ u_int16_t pppoe_rfc_disconnect(void *data)
     if (rfc->flags & PPPOE_FLAG_DEBUG)
         IOLog("PPPoE disconnect (%p)\n", rfc);
 
-    send_PAD(rfc, rfc->peer_address, PPPOE_PADT, rfc->session_id, 0, 0, 0, 0, 0);
+    send_PAD(rfc, rfc->peer_address, PPPOE_PADT, rfc->session_id, 0, 0, 0, 0, 0, 0);
 
-    rfc->state = PPPOE_STATE_DISCONNECTED;
+    pppoe_rfc_set_state(rfc, PPPOE_STATE_DISCONNECTED);
     bzero(rfc->peer_address, sizeof(rfc->peer_address));
     send_event(rfc, PPPOE_EVT_DISCONNECTED, 0);
 
@@ -484,10 +582,13 @@ void pppoe_rfc_clone(void *data1, void *data2)
     host2 = rfc2->host;
     if (rfc2->ifp)
         pppoe_dlil_detach(rfc2->ifp);
+    pppoe_rfc_unlink(rfc2);
     TAILQ_REMOVE(&pppoe_rfc_head, rfc2, next);
     bcopy(data1, data2, sizeof(struct pppoe_rfc));
     rfc2->host = host2;
     TAILQ_INSERT_TAIL(&pppoe_rfc_head, rfc2, next);
+    rfc2->hash_index = PPPOE_RFC_HASH_NONE;
+    pppoe_rfc_set_state(rfc2, rfc2->state);
     // cannot fail, there is no attachment done, and it's is just refcnt bumping
     if (rfc2->ifp)
         pppoe_dlil_attach(rfc2->unit, &rfc2->ifp);
@@ -513,6 +614,18 @@ void pppoe_rfc_timer()
     struct pppoe_rfc  	*rfc;
 
     lck_mtx_assert(ppp_domain_mutex, LCK_MTX_ASSERT_OWNED);
+
+    // refill the discovery budgets
+    pppoe_discovery_tokens = pppoe_discovery_rate;
+    bzero(pppoe_discovery_mac_table, sizeof(pppoe_discovery_mac_table));
+    read_random(&pppoe_discovery_mac_key, sizeof(pppoe_discovery_mac_key));
+
+    // rotate the cookie secret, cookies from the previous period stay valid
+    if (++pppoe_cookie_timer >= PPPOE_COOKIE_ROTATE) {
+        pppoe_cookie_timer = 0;
+        bcopy(pppoe_cookie_secret[0], pppoe_cookie_secret[1], PPPOE_COOKIE_SECRET_LEN);
+        read_random(pppoe_cookie_secret[0], PPPOE_COOKIE_SECRET_LEN);
+    }
 	
     TAILQ_FOREACH(rfc, &pppoe_rfc_head, next) {
 
@@ -522,7 +635,7 @@ void pppoe_rfc_timer()
                 if (rfc->timer_connect == 0) {
                     if (rfc->flags & PPPOE_FLAG_DEBUG)
                         IOLog("PPPoE timer (%p): CONNECT_TIMER expires\n", rfc);
-                    rfc->state = PPPOE_STATE_DISCONNECTED;
+                    pppoe_rfc_set_state(rfc, PPPOE_STATE_DISCONNECTED);
                     bzero(rfc->peer_address, sizeof(rfc->peer_address));
                     // double-check for the error number ?
                     send_event(rfc, PPPOE_EVT_DISCONNECTED, 
@@ -533,6 +646,7 @@ void pppoe_rfc_timer()
                         rfc->timer_connect_resend -= rfc->timer_retry_setup;
                         send_PAD(rfc, rfc->peer_address, 
                         rfc->state == PPPOE_STATE_LOOKING ? PPPOE_PADI : PPPOE_PADR, 0, 
+                        check_max_payload(rfc, rfc->max_payload),
                         rfc->ac_name.len ? &rfc->ac_name : 0, &rfc->service,
                         &rfc->host_uniq, 
                         rfc->ac_cookie.len ? &rfc->ac_cookie : 0, 
@@ -544,7 +658,7 @@ void pppoe_rfc_timer()
                 if (rfc->timer_ring == 0) {
                     if (rfc->flags & PPPOE_FLAG_DEBUG)
                         IOLog("PPPoE timer (%p): RING_TIMER expires\n", rfc);
-                    rfc->state = PPPOE_STATE_DISCONNECTED;
+                    pppoe_rfc_set_state(rfc, PPPOE_STATE_DISCONNECTED);
                     bzero(rfc->peer_address, sizeof(rfc->peer_address));
                     send_event(rfc, PPPOE_EVT_DISCONNECTED, 0);
                     break;
@@ -556,56 +670,78 @@ void pppoe_rfc_timer()
 }
 
 /* -----------------------------------------------------------------------------
+m can be a chain of packets, they are sent to the interface in a single call
+m is always consumed. packets and bytes (can be NULL) get what was actually
+sent, a failure can stop the chain after some packets already went out
 ----------------------------------------------------------------------------- */
-u_int16_t pppoe_rfc_output(void *data, mbuf_t m)
+u_int16_t pppoe_rfc_output(void *data, mbuf_t m, u_int32_t *packets, u_int32_t *bytes)
 {
     struct pppoe_rfc 	*rfc = (struct pppoe_rfc *)data;
-    // u_int8_t 		*d;
-    struct pppoe	*p, p_data;
-    mbuf_t			m0;
-    u_int16_t 		skip, len;
+    mbuf_t		m0, next, head = 0, last = 0;
+    u_int16_t 		len, error = 0;
+    u_int32_t		sent_packets = 0, sent_bytes = 0;
 	
 	lck_mtx_assert(ppp_domain_mutex, LCK_MTX_ASSERT_OWNED);
 
-    len = 0;
-    for (m0 = m; m0 != 0; m0 = mbuf_next(m0))
-        len += mbuf_len(m0);
+    if (packets)
+        *packets = 0;
+    if (bytes)
+        *bytes = 0;
 
-    if (rfc->state != PPPOE_STATE_CONNECTED)
+    if (rfc->state != PPPOE_STATE_CONNECTED) {
+        mbuf_freem_list(m);
         return ENXIO;
+    }
 
-   // IOLog("PPPoE write, len = %d\n", len);
-    //d = mtod(m, u_int8_t *);
-    //IOLog("PPPoE write, data = %x %x %x %x %x %x \n", d[0], d[1], d[2], d[3], d[4], d[5]);
+    for (; m; m = next) {
+        next = mbuf_nextpkt(m);
+        mbuf_setnextpkt(m, 0);
 
-    skip = 0;
-#if 0        // FF03 is not sent and ACFC option MUST not be negociated
-             // test anyway if we start with FF03
-    d = mtod(m, u_int8_t *);
-    if (d[0] == 0xFF && d[1] == 3)
-        skip = 2;
-#endif
+        len = 0;
+        for (m0 = m; m0 != 0; m0 = mbuf_next(m0))
+            len += mbuf_len(m0);
+
+        // FF03 is not sent and ACFC option MUST not be negociated
+        if (mbuf_prepend(&m, PPPOE_DATA_HDR_LEN, MBUF_WAITOK) != 0) {
+            IOLog("pppoe_rfc_output: failed mbuf_prepend\n");
+            if (next)
+                mbuf_freem_list(next);
+            error = ENOBUFS;
+            break;
+        }
+
+        // No need to set MBUF_PKTHDR, since m must already be a header
+        // copy the template and patch the pppoe payload len
+        len = htons(len);
+        memcpy(mbuf_data(m), rfc->data_hdr, PPPOE_DATA_HDR_LEN - 2);
+        memcpy((u_int8_t *)mbuf_data(m) + PPPOE_DATA_HDR_LEN - 2, &len, 2);
+        mbuf_pkthdr_setlen(m, ntohs(len) + PPPOE_DATA_HDR_LEN);
+
+        sent_packets++;
+        sent_bytes += ntohs(len);
+
+        if (rfc->flags & PPPOE_FLAG_LOOPBACK) {
+            // loopback goes through the regular path, without the ethernet header
+            mbuf_adj(m, PPPOE_DATA_HDR_LEN - sizeof(struct pppoe));
+            pppoe_rfc_lower_output(rfc, m, rfc->peer_address, PPPOE_ETHERTYPE_DATA);
+            continue;
+        }
 
-    if (mbuf_prepend(&m, sizeof(struct pppoe) - skip , MBUF_WAITOK) != 0) {
-        IOLog("pppoe_rfc_output: failed mbuf_prepend\n");
-        return ENOBUFS;
+        if (last)
+            mbuf_setnextpkt(last, m);
+        else
+            head = m;
+        last = m;
     }
-    // d = mbuf_data(m);
 
-    // No need to set MBUF_PKTHDR, since m must already be a header
-    
-    p = &p_data;
-    memcpy(p, mbuf_data(m), sizeof(p_data));
-    p->ver = PPPOE_VER;
-    p->typ = PPPOE_TYPE;
-    p->code = 0;
-    p->sessid = htons(rfc->session_id);
-    p->len = htons(len - skip); // tag len
-    memcpy(mbuf_data(m), p, sizeof(p_data));
-    mbuf_pkthdr_setlen(m, len + sizeof(struct pppoe) - skip);
+    if (head)
+        pppoe_dlil_output_raw(rfc->ifp, head);
 
-    pppoe_rfc_lower_output(rfc, m, rfc->peer_address, PPPOE_ETHERTYPE_DATA);
-    return 0;
+    if (packets)
+        *packets = sent_packets;
+    if (bytes)
+        *bytes = sent_bytes;
+    return error;
 }
 
 /* -----------------------------------------------------------------------------
@@ -646,6 +782,8 @@ u_int16_t pppoe_rfc_command(void *data, u_int32_t cmd, void *cmddata)
                         return 1;
                     rfc->unit = unit;
                 }
+                // the interface is part of the session key
+                pppoe_rfc_set_state(rfc, rfc->state);
              }
             break;
 
@@ -705,6 +843,24 @@ u_int16_t pppoe_rfc_command(void *data, u_int32_t cmd, void *cmddata)
             bcopy(cmddata, rfc->peer_address, ETHER_ADDR_LEN);
             break;
 
+        // set the PPP-Max-Payload to ask for, must be called before connect
+        case PPPOE_CMD_SETMAXPAYLOAD:
+            if (rfc->flags & PPPOE_FLAG_DEBUG)
+                IOLog("PPPoE command (%p): set max payload = %d\n", rfc, *(u_int16_t *)cmddata);
+            if (rfc->state != PPPOE_STATE_DISCONNECTED) {
+                error = 1;
+                break;
+            }
+            rfc->max_payload = *(u_int16_t *)cmddata;
+            break;
+
+        // return the payload size agreed with the peer, PPPOE_MTU if not negotiated
+        case PPPOE_CMD_GETMAXPAYLOAD:
+            *(u_int16_t *)cmddata = rfc->peer_max_payload ? rfc->peer_max_payload : PPPOE_MTU;
+            if (rfc->flags & PPPOE_FLAG_DEBUG)
+                IOLog("PPPoE command (%p): get max payload = %d\n", rfc, *(u_int16_t *)cmddata);
+            break;
+
         // return the ethernet address we are connected to
         // broadcast and zero-address are treated the same way.
         case PPPOE_CMD_GETPEERADDR:
@@ -860,7 +1016,7 @@ u_int16_t add_tag(u_int8_t *data, u_int16_t tag, struct pppoe_tag *val)
 /* -----------------------------------------------------------------------------
 address MUST be a valid ethernet address (6 bytes length)
 ----------------------------------------------------------------------------- */
-void send_PAD(struct pppoe_rfc *rfc, u_int8_t *address, u_int16_t code, u_int16_t sessid,
+void send_PAD(struct pppoe_rfc *rfc, u_int8_t *address, u_int16_t code, u_int16_t sessid, u_int16_t max_payload,
                      struct pppoe_tag *ac_name, struct pppoe_tag *service,
                      struct pppoe_tag *host_uniq, struct pppoe_tag *ac_cookie,
                      struct pppoe_tag *relay_id)
@@ -921,6 +1077,14 @@ void send_PAD(struct pppoe_rfc *rfc, u_int8_t *address, u_int16_t code, u_int16_
         data += len;
     }
 
+    if (max_payload) {
+        *(u_int16_t *)data = htons(PPPOE_TAG_PPP_MAX_PAYLOAD);
+        *(u_int16_t *)(data + 2) = htons(2);
+        *(u_int16_t *)(data + 4) = htons(max_payload);
+        p->len += 6;
+        data += 6;
+    }
+
     mbuf_setlen(m, sizeof(struct pppoe) + p->len);
     mbuf_pkthdr_setlen(m, sizeof(struct pppoe) + p->len);
     p->len = htons(p->len);
@@ -929,6 +1093,135 @@ void send_PAD(struct pppoe_rfc *rfc, u_int8_t *address, u_int16_t code, u_int16_
     pppoe_rfc_lower_output(rfc, m, address, PPPOE_ETHERTYPE_CTRL);
 }
 
+/* -----------------------------------------------------------------------------
+compute the ac-cookie for a client address, using the given secret
+HMAC-SHA1 over the interface index and the client address, truncated
+----------------------------------------------------------------------------- */
+void make_cookie(u_int8_t *secret, ifnet_t ifp, u_int8_t *address, struct pppoe_tag *cookie)
+{
+    SHA1_CTX	ctx;
+    u_int8_t	pad[64], digest[SHA1_RESULTLEN];
+    u_int32_t	index = ifp ? ifnet_index(ifp) : 0;
+    int		i;
+
+    bzero(pad, sizeof(pad));
+    bcopy(secret, pad, PPPOE_COOKIE_SECRET_LEN);
+    for (i = 0; i < sizeof(pad); i++)
+        pad[i] ^= 0x36;
+    SHA1Init(&ctx);
+    SHA1Update(&ctx, pad, sizeof(pad));
+    SHA1Update(&ctx, &index, sizeof(index));
+    SHA1Update(&ctx, address, ETHER_ADDR_LEN);
+    SHA1Final(digest, &ctx);
+
+    for (i = 0; i < sizeof(pad); i++)
+        pad[i] ^= 0x36 ^ 0x5c;
+    SHA1Init(&ctx);
+    SHA1Update(&ctx, pad, sizeof(pad));
+    SHA1Update(&ctx, digest, sizeof(digest));
+    SHA1Final(digest, &ctx);
+
+    bcopy(digest, cookie->data, PPPOE_COOKIE_LEN);
+    cookie->len = PPPOE_COOKIE_LEN;
+}
+
+/* -----------------------------------------------------------------------------
+check the ac-cookie returned in a PADR
+return 1 if the cookie was issued by us to this address, 0 otherwise
+----------------------------------------------------------------------------- */
+u_int16_t check_cookie(ifnet_t ifp, mbuf_t m, u_int8_t *address)
+{
+    PPPOE_TAG(cookie, PPPOE_AC_COOKIE_LEN);
+    PPPOE_TAG(expected, PPPOE_AC_COOKIE_LEN);
+    int		i;
+
+    PPPOE_TAG_SETUP(cookie);
+    PPPOE_TAG_SETUP(expected);
+
+    if (!get_tag(m, PPPOE_TAG_AC_COOKIE, &cookie))
+        return 0;
+
+    for (i = 0; i < 2; i++) {
+        make_cookie(pppoe_cookie_secret[i], ifp, address, &expected);
+        if (!PPPOE_TAG_CMP(cookie, expected))
+            return 1;
+    }
+    return 0;
+}
+
+/* -----------------------------------------------------------------------------
+account for a PADI/PADR from address
+return 1 if the frame is within the global and per address budgets, 0 otherwise
+----------------------------------------------------------------------------- */
+u_int16_t check_discovery_rate(u_int8_t *address)
+{
+    u_int16_t	*count = 0;
+    u_int32_t	h;
+    int		i;
+
+    // check the address first, a flooding client must not spend the global budget
+    if (pppoe_discovery_mac_rate) {
+        // FNV-1a with a secret offset, and a final mix so that all the bits count
+        h = pppoe_discovery_mac_key;
+        for (i = 0; i < ETHER_ADDR_LEN; i++)
+            h = (h ^ address[i]) * 0x01000193;
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        count = &pppoe_discovery_mac_table[h % PPPOE_DISCOVERY_MAC_HASH];
+        // addresses sharing a bucket share its budget, nothing resets it
+        if (*count >= pppoe_discovery_mac_rate)
+            goto drop;
+    }
+
+    if (pppoe_discovery_rate) {
+        if (pppoe_discovery_tokens <= 0)
+            goto drop;
+        pppoe_discovery_tokens--;
+    }
+
+    if (count)
+        (*count)++;
+    return 1;
+
+drop:
+    pppoe_discovery_dropped_rate++;
+    return 0;
+}
+
+/* -----------------------------------------------------------------------------
+return the PPP-Max-Payload (RFC 4638) we can use on the interface, given the
+value we or the peer would like, 0 if the standard mtu must be used
+the ethernet mtu must carry the payload plus the pppoe header and ppp protocol
+----------------------------------------------------------------------------- */
+u_int16_t check_max_payload(struct pppoe_rfc *rfc, u_int16_t max_payload)
+{
+    u_int32_t 	mtu;
+
+    if (max_payload <= PPPOE_MTU || rfc->ifp == 0)
+        return 0;
+
+    mtu = ifnet_mtu(rfc->ifp);
+    if (mtu < PPPOE_MTU + PPPOE_OVERHEAD + 1)
+        return 0;
+    if (max_payload > mtu - PPPOE_OVERHEAD)
+        max_payload = mtu - PPPOE_OVERHEAD;
+    return max_payload;
+}
+
+/* -----------------------------------------------------------------------------
+return the value of the PPP-Max-Payload tag, 0 if not present or malformed
+----------------------------------------------------------------------------- */
+u_int16_t get_max_payload(mbuf_t m)
+{
+    PPPOE_TAG(max_payload, 2);
+
+    PPPOE_TAG_SETUP(max_payload);
+    if (!get_tag(m, PPPOE_TAG_PPP_MAX_PAYLOAD, &max_payload) || max_payload.len != 2)
+        return 0;
+    return ntohs(*(u_int16_t *)max_payload.data);
+}
+
 /* -----------------------------------------------------------------------------
 m contains ethernet header and the actual ethernet data
 from MUST be a valid ethernet address (6 bytes length)
@@ -939,6 +1232,7 @@ u_int16_t handle_PADI(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from)
     PPPOE_TAG(service, PPPOE_SERVICE_LEN);
     PPPOE_TAG(hostuniq, PPPOE_HOST_UNIQ_LEN);
     PPPOE_TAG(relay, PPPOE_RELAY_ID_LEN);
+    PPPOE_TAG(cookie, PPPOE_AC_COOKIE_LEN);
 
     if (rfc->state != PPPOE_STATE_LISTENING)
         return 0;
@@ -947,6 +1241,7 @@ u_int16_t handle_PADI(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from)
     PPPOE_TAG_SETUP(service);
     PPPOE_TAG_SETUP(hostuniq);
     PPPOE_TAG_SETUP(relay);
+    PPPOE_TAG_SETUP(cookie);
 
     get_tag(m, PPPOE_TAG_AC_NAME, &name);
     get_tag(m, PPPOE_TAG_SERVICE_NAME, &service);
@@ -964,9 +1259,9 @@ u_int16_t handle_PADI(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from)
         get_tag(m, PPPOE_TAG_HOST_UNIQ, &hostuniq);
         get_tag(m, PPPOE_TAG_RELAY_SESSION_ID, &relay);
 
-        // could generate and use ac-cookie, but in that case we would need to change state
-        // do it later...
-        send_PAD(rfc, from, PPPOE_PADO, 0, &rfc->serv_ac_name, service.len ? &service : 0, hostuniq.len ? &hostuniq : 0, 0, relay.len ? &relay : 0);
+        // the ac-cookie is derived from the client address, no state is kept until PADR
+        make_cookie(pppoe_cookie_secret[0], rfc->ifp, from, &cookie);
+        send_PAD(rfc, from, PPPOE_PADO, 0, check_max_payload(rfc, get_max_payload(m)), &rfc->serv_ac_name, service.len ? &service : 0, hostuniq.len ? &hostuniq : 0, &cookie, relay.len ? &relay : 0);
         return 1;
     }
 
@@ -1023,11 +1318,12 @@ u_int16_t handle_PADO(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from)
         rfc->timer_connect_resend = rfc->timer_connect - rfc->timer_retry_setup;
 
         send_PAD(rfc, rfc->peer_address, PPPOE_PADR, 0, 
+                check_max_payload(rfc, rfc->max_payload),
                 rfc->ac_name.len ? &rfc->ac_name : 0, &rfc->service,
                 &rfc->host_uniq, 
                 rfc->ac_cookie.len ? &rfc->ac_cookie : 0, 
                 rfc->relay_id.len ? &rfc->relay_id : 0);
-        rfc->state = PPPOE_STATE_CONNECTING;
+        pppoe_rfc_set_state(rfc, PPPOE_STATE_CONNECTING);
         return 1;
 #ifndef PPPENET_COMPAT
     }
@@ -1065,10 +1361,12 @@ u_int16_t handle_PADR(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from)
         
         get_tag(m, PPPOE_TAG_HOST_UNIQ, &rfc->host_uniq);
         get_tag(m, PPPOE_TAG_RELAY_SESSION_ID, &rfc->relay_id);
+        // echoed in the PADS if we can carry it
+        rfc->peer_max_payload = check_max_payload(rfc, get_max_payload(m));
 
         // change the state, so there is no other client trying to call...
         rfc->timer_ring = rfc->timer_ring_setup;
-        rfc->state = PPPOE_STATE_RINGING;
+        pppoe_rfc_set_state(rfc, PPPOE_STATE_RINGING);
         send_event(rfc, PPPOE_EVT_RINGING, 0);
 
         // only ring to the first client that matches...
@@ -1110,8 +1408,14 @@ u_int16_t handle_PADS(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from)
         ) {
 #endif
 //        bcopy(from, rfc->peer_address, ETHER_ADDR_LEN);
-        rfc->state = PPPOE_STATE_CONNECTED;
         rfc->session_id = sessid;
+        // the server agrees on a bigger payload by echoing the tag, never above what we asked
+        rfc->peer_max_payload = check_max_payload(rfc, get_max_payload(m));
+        if (rfc->peer_max_payload > rfc->max_payload)
+            rfc->peer_max_payload = check_max_payload(rfc, rfc->max_payload);
+        if (rfc->flags & PPPOE_FLAG_DEBUG)
+            IOLog("PPPoE receive PADS (%p): max payload = %d\n", rfc, rfc->peer_max_payload ? rfc->peer_max_payload : PPPOE_MTU);
+        pppoe_rfc_set_state(rfc, PPPOE_STATE_CONNECTED);
         send_event(rfc, PPPOE_EVT_CONNECTED, 0);
 
         return 1;
@@ -1141,7 +1445,7 @@ u_int16_t handle_PADT(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *from)
 
     if ((sessid == rfc->session_id) && !bcmp(rfc->peer_address, from, ETHER_ADDR_LEN)) {
 
-        rfc->state = PPPOE_STATE_DISCONNECTED;
+        pppoe_rfc_set_state(rfc, PPPOE_STATE_DISCONNECTED);
         bzero(rfc->peer_address, sizeof(rfc->peer_address));
         send_event(rfc, PPPOE_EVT_DISCONNECTED, 0);
 
@@ -1269,29 +1573,145 @@ void pppoe_rfc_lower_output(struct pppoe_rfc *rfc, mbuf_t m, u_int8_t *to, u_int
     pppoe_dlil_output(rfc->ifp, m, to, typ);
 }
 
+/* -----------------------------------------------------------------------------
+hash a session key
+----------------------------------------------------------------------------- */
+static u_int32_t pppoe_rfc_hash(ifnet_t ifp, u_int16_t sessid, u_int8_t *address)
+{
+    u_int32_t h;
+
+    h = sessid ^ ((address[4] << 8) | address[5]) ^ (u_int32_t)((uintptr_t)ifp >> 4);
+    h ^= (address[2] << 8) | address[3];
+    return h % PPPOE_RFC_MAX_HASH;
+}
+
+/* -----------------------------------------------------------------------------
+remove the rfc from the session hash or discovery list
+----------------------------------------------------------------------------- */
+static void pppoe_rfc_unlink(struct pppoe_rfc *rfc)
+{
+    if (rfc->hash_index == PPPOE_RFC_HASH_DISCOVERY)
+        TAILQ_REMOVE(&pppoe_rfc_discovery_head, rfc, hash_next);
+    else if (rfc->hash_index != PPPOE_RFC_HASH_NONE)
+        TAILQ_REMOVE(&pppoe_rfc_session_hash[rfc->hash_index], rfc, hash_next);
+    rfc->hash_index = PPPOE_RFC_HASH_NONE;
+}
+
+/* -----------------------------------------------------------------------------
+build the ethernet and pppoe headers used for every data packet of the session
+only the pppoe payload len needs to be patched when sending
+----------------------------------------------------------------------------- */
+static void pppoe_rfc_build_data_hdr(struct pppoe_rfc *rfc)
+{
+    u_int8_t 		*d = rfc->data_hdr;
+    struct pppoe	p_data;
+    u_int16_t		typ = htons(PPPOE_ETHERTYPE_DATA);
+
+    bzero(rfc->data_hdr, sizeof(rfc->data_hdr));
+    bcopy(rfc->peer_address, d, ETHER_ADDR_LEN);
+    if (rfc->ifp)
+        ifnet_lladdr_copy_bytes(rfc->ifp, d + ETHER_ADDR_LEN, ETHER_ADDR_LEN);
+    memcpy(d + ETHER_ADDR_LEN * 2, &typ, 2);
+
+    bzero(&p_data, sizeof(p_data));
+    p_data.ver = PPPOE_VER;
+    p_data.typ = PPPOE_TYPE;
+    p_data.code = 0;
+    p_data.sessid = htons(rfc->session_id);
+    memcpy(d + ETHER_ADDR_LEN * 2 + 2, &p_data, sizeof(p_data));
+}
+
+/* -----------------------------------------------------------------------------
+change the state of the rfc and move it to the index matching the new state
+for the connected state, interface, session id and peer address must be set
+----------------------------------------------------------------------------- */
+static void pppoe_rfc_set_state(struct pppoe_rfc *rfc, u_int16_t state)
+{
+    pppoe_rfc_unlink(rfc);
+    rfc->state = state;
+
+    switch (state) {
+        case PPPOE_STATE_CONNECTED:
+            pppoe_rfc_build_data_hdr(rfc);
+            rfc->hash_index = pppoe_rfc_hash(rfc->ifp, rfc->session_id, rfc->peer_address);
+            TAILQ_INSERT_TAIL(&pppoe_rfc_session_hash[rfc->hash_index], rfc, hash_next);
+            break;
+        case PPPOE_STATE_LOOKING:
+        case PPPOE_STATE_CONNECTING:
+        case PPPOE_STATE_LISTENING:
+            rfc->hash_index = PPPOE_RFC_HASH_DISCOVERY;
+            TAILQ_INSERT_TAIL(&pppoe_rfc_discovery_head, rfc, hash_next);
+            break;
+    }
+}
+
 /* -----------------------------------------------------------------------------
 called from pppoe_dlil when pppoe data are present
 ----------------------------------------------------------------------------- */
 void pppoe_rfc_lower_input(ifnet_t ifp, mbuf_t m, u_int8_t *from, u_int16_t typ)
 {
     struct pppoe_rfc  	*rfc, *lastrfc = 0;
+    struct pppoe	p_data;
+    u_int16_t		sessid;
     
     //IOLog("PPPoE inputdata, tag = %d\n", dl_tag);
 	
 	lck_mtx_assert(ppp_domain_mutex, LCK_MTX_ASSERT_OWNED);
 
-    TAILQ_FOREACH(rfc, &pppoe_rfc_head, next) {
-        // we use dl_tag because we only respond to the peer on the same interface
-        if (rfc->ifp == ifp) {
+    if (mbuf_len(m) < sizeof(struct pppoe)) {
+        mbuf_freem(m);
+        return;
+    }
+    memcpy(&p_data, mbuf_data(m), sizeof(p_data));
+    sessid = ntohs(p_data.sessid);
+
+    if (typ == PPPOE_ETHERTYPE_DATA || p_data.code == PPPOE_PADT) {
+        // data and PADT are for a connected session, look it up directly
+        TAILQ_FOREACH(rfc, &pppoe_rfc_session_hash[pppoe_rfc_hash(ifp, sessid, from)], hash_next) {
+            if (rfc->ifp == ifp
+                && rfc->session_id == sessid
+                && !bcmp(rfc->peer_address, from, ETHER_ADDR_LEN)) {
 
-            if (pppoe_rfc_input(rfc, m, from, typ))
+                if (pppoe_rfc_input(rfc, m, from, typ))
+                    return;
+            }
+        }
+    }
+    else {
+        if (p_data.code == PPPOE_PADI || p_data.code == PPPOE_PADR) {
+            // only an access concentrator handles PADI/PADR, the limits apply if somebody listens on ifp
+            TAILQ_FOREACH(rfc, &pppoe_rfc_discovery_head, hash_next) {
+                if (rfc->ifp == ifp && rfc->state == PPPOE_STATE_LISTENING)
+                    break;
+            }
+            // protect the access concentrator against discovery storms
+            if (rfc && !check_discovery_rate(from)) {
+                mbuf_freem(m);
+                return;
+            }
+            // only clients that got our PADO can create a session
+            if (rfc && p_data.code == PPPOE_PADR && !check_cookie(ifp, m, from)) {
+                pppoe_discovery_dropped_cookie++;
+                mbuf_freem(m);
+                return;
+            }
+        }
+
+        TAILQ_FOREACH(rfc, &pppoe_rfc_discovery_head, hash_next) {
+            // we use dl_tag because we only respond to the peer on the same interface
+            if (rfc->ifp == ifp
+                && pppoe_rfc_input(rfc, m, from, typ))
                 return;
-                
-            lastrfc = rfc;
         }
     }
 
-    // the last matching rfc itself is irrelevant, just need unit number and tag information
+    // the matching rfc itself is irrelevant, just need unit number and tag information
+    TAILQ_FOREACH(rfc, &pppoe_rfc_head, next) {
+        if (rfc->ifp == ifp) {
+            lastrfc = rfc;
+            break;
+        }
+    }
     
     IOLog("PPPoE inputdata: unexpected %s packet on unit = %d\n", 
         (typ == PPPOE_ETHERTYPE_CTRL ? "control" : "data"), lastrfc ? lastrfc->unit : -1);
@@ -1299,14 +1719,8 @@ void pppoe_rfc_lower_input(ifnet_t ifp, mbuf_t m, u_int8_t *from, u_int16_t typ)
     if (typ == PPPOE_ETHERTYPE_DATA) {
         // in case of PPPOE_ETHERTYPE_DATA, send a PADT to the peer
         // trying to talk to us with an incorrect session id
-        struct pppoe	p_data;
-        u_int16_t	sessid;
-
-	memcpy(&p_data, mbuf_data(m), sizeof(p_data));
-	sessid = ntohs(p_data.sessid);
-
         if (lastrfc)
-            send_PAD(lastrfc, from, PPPOE_PADT, sessid, 0, 0, 0, 0, 0);
+            send_PAD(lastrfc, from, PPPOE_PADT, sessid, 0, 0, 0, 0, 0, 0);
     }
     
     // nobody was intersted in the packet, just ignore it
@@ -1333,7 +1747,7 @@ void pppoe_rfc_lower_detaching(ifnet_t ifp)
         
             if (rfc->state != PPPOE_STATE_DISCONNECTED) {
         
-                rfc->state = PPPOE_STATE_DISCONNECTED;
+                pppoe_rfc_set_state(rfc, PPPOE_STATE_DISCONNECTED);
                 bzero(rfc->peer_address, sizeof(rfc->peer_address));
                 send_event(rfc, PPPOE_EVT_DISCONNECTED, ENXIO);
             }
@@ -27,6 +27,7 @@
 #define __PPPOE_RFC_H__
 
 #define PPPOE_MTU	1492
+#define PPPOE_OVERHEAD	8	/* pppoe header + ppp protocol field */
 
 enum {
     PPPOE_STATE_DISCONNECTED = 0,
@@ -58,7 +59,9 @@ enum {
     PPPOE_CMD_SETPEERADDR,	// set peer ethernet address
     PPPOE_CMD_GETPEERADDR,	// get peer ethernet address
     PPPOE_CMD_SETRETRYTIMER, 	// set ring timer
-    PPPOE_CMD_GETRETRYTIMER 	// get ring timer
+    PPPOE_CMD_GETRETRYTIMER, 	// get ring timer
+    PPPOE_CMD_SETMAXPAYLOAD,	// set PPP-Max-Payload to ask for
+    PPPOE_CMD_GETMAXPAYLOAD	// get negotiated PPP-Max-Payload
 };
 
 typedef void (*pppoe_rfc_event_callback)(void *data, u_int32_t event, u_int32_t msg);
@@ -85,7 +88,7 @@ u_int16_t pppoe_rfc_command(void *userdata, u_int32_t cmd, void *cmddata);
 
 void pppoe_rfc_timer(void);
 
-u_int16_t pppoe_rfc_output(void *data, mbuf_t m);
+u_int16_t pppoe_rfc_output(void *data, mbuf_t m, u_int32_t *packets, u_int32_t *bytes);
 
 // callback from dlil layer
 void pppoe_rfc_lower_input(ifnet_t ifp, mbuf_t m, u_int8_t *from, u_int16_t typ);
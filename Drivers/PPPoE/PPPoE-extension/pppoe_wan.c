@@ -138,7 +138,7 @@ int pppoe_wan_attach(void *rfc, struct ppp_link **link)
     int 		ret;	
     struct pppoe_wan  	*wan;
     struct ppp_link  	*lk;
-    u_short 		unit;
+    u_short 		unit, mtu;
 	
 	lck_mtx_assert(ppp_domain_mutex, LCK_MTX_ASSERT_OWNED);
 
@@ -159,15 +159,17 @@ int pppoe_wan_attach(void *rfc, struct ppp_link **link)
     
     // it's time now to register our brand new link
     lk->lk_name 	= (u_char*)PPPOE_NAME;
-    lk->lk_mtu 		= PPPOE_MTU;
-    lk->lk_mru 		= PPPOE_MTU;;
+    // PPPOE_MTU, unless a bigger payload was negotiated during discovery (RFC 4638)
+    pppoe_rfc_command(rfc, PPPOE_CMD_GETMAXPAYLOAD, &mtu);
+    lk->lk_mtu 		= mtu;
+    lk->lk_mru 		= mtu;
     lk->lk_type 	= PPP_TYPE_PPPoE;
     lk->lk_hdrlen 	= 14; // ethernet header len
     //ld->lk_if.link_lk_baudrate = tp->t_ospeed;
     lk->lk_ioctl 	= pppoe_wan_ioctl;
     lk->lk_output 	= pppoe_wan_output;
     lk->lk_unit 	= unit;
-    lk->lk_support 	= PPP_LINK_DEL_AC;
+    lk->lk_support 	= PPP_LINK_DEL_AC | PPP_LINK_BATCH;
     wan->rfc = rfc;
 
     ret = ppp_link_attach((struct ppp_link *)wan);
@@ -267,19 +269,26 @@ int pppoe_wan_output(struct ppp_link *link, mbuf_t m)
 {
     struct pppoe_wan 	*wan = (struct pppoe_wan *)link;
     int			err;
+    u_int32_t		packets = 0, sent_packets, sent_bytes;
+    mbuf_t		m0;
 	struct timespec tv;	
     
 	lck_mtx_assert(ppp_domain_mutex, LCK_MTX_ASSERT_OWNED);
+
+    // m can be a chain of packets, count them before they are gone
+    for (m0 = m; m0; m0 = mbuf_nextpkt(m0))
+        packets++;
 	
-    if ((err = pppoe_rfc_output(wan->rfc, m))) {
-        link->lk_oerrors++;
-        return err;
+    // m is consumed, part of the chain may have been sent even on error
+    err = pppoe_rfc_output(wan->rfc, m, &sent_packets, &sent_bytes);
+
+    link->lk_oerrors += packets - sent_packets;
+    if (sent_packets) {
+        link->lk_opackets += sent_packets;
+        link->lk_obytes += sent_bytes;
+        //getmicrotime(link->lk_last_xmit);
+        nanouptime(&tv);
+        link->lk_last_xmit = tv.tv_sec;
     }
-
-    link->lk_opackets++;
-    link->lk_obytes += mbuf_pkthdr_len(m);
-    //getmicrotime(link->lk_last_xmit);
-	nanouptime(&tv);
-	link->lk_last_xmit = tv.tv_sec;
-    return 0;
+    return err;
 }
@@ -96,12 +96,13 @@ void pppoe_disconnect(void);
 void pppoe_close(void);
 void pppoe_cleanup(void);
 int pppoe_establish_ppp(int);
-void pppoe_wait_input(void);
 void pppoe_disestablish_ppp(int);
 void pppoe_link_down(void *arg, uintptr_t p);
 
 static int pppoe_dial(void);
 static int pppoe_listen(void);
+static void pppoe_use_max_payload(void);
+static void pppoe_sock_ready(int fd, void *arg);
 static void closeall(void);
 static u_long load_kext(char *kext, int byBundleID);
 
@@ -121,6 +122,7 @@ static char	*service = NULL; 		/* service selection to use */
 static char	*access_concentrator = NULL; 	/* access concentrator to connect to */
 static int	retrytimer = 0; 		/* retry timer (default is 3 seconds) */
 static int	connecttimer = 65; 		/* bump the connection timer from 20 to 65 seconds */
+static int	maxpayload = 0; 		/* PPP-Max-Payload to ask for, RFC 4638 (default is not to ask) */
 static bool	linkdown = 0; 			/* flag set when we receive link down event */
 
 extern int kill_link;
@@ -141,6 +143,8 @@ option_t pppoe_options[] = {
       "Connect timer for outgoing call (default 65 seconds)" },
     { "pppoeretrytimer", o_int, &retrytimer,
       "Retry timer for outgoing call (default 3 seconds)" },
+    { "pppoemaxpayload", o_int, &maxpayload,
+      "PPP-Max-Payload to negotiate, for a 1500 bytes MTU over Ethernet (RFC 4638)" },
     { NULL }
 };
 
@@ -158,7 +162,6 @@ int start(CFBundleRef ref)
     bzero(the_channel, sizeof(struct channel));
     the_channel->options = pppoe_options;
     the_channel->process_extra_options = pppoe_process_extra_options;
-    the_channel->wait_input = pppoe_wait_input;
     the_channel->check_options = pppoe_check_options;
     the_channel->connect = pppoe_connect;
     the_channel->disconnect = pppoe_disconnect;
@@ -204,26 +207,23 @@ void pppoe_check_options()
 }
 
 /* ----------------------------------------------------------------------------- 
-called back everytime we go out of select, and data needs to be read
-the hook is called and has a chance to get data out of its file descriptor
+called back by wait_input when our socket is ready
 in the case of PPPoE, we are not supposed to get data on the socket
 if our socket gets awaken, that's because is has been closed
 ----------------------------------------------------------------------------- */
-void pppoe_wait_input()
+static void pppoe_sock_ready(int fd, void *arg)
 {
    
-    if (sockfd != -1 && is_ready_fd(sockfd)) {
-        // looks like we have been disconnected...
-        // the status is updated only if link is not already down
-        if (linkdown == 0) {
-            notice("PPPoE hangup");
-            status = EXIT_HANGUP;
-        }
-        remove_fd(sockfd);
-        hungup = 1;
-        lcp_lowerdown(0);	/* PPPoE link is no longer available */
-        link_terminated(0);
+    // looks like we have been disconnected...
+    // the status is updated only if link is not already down
+    if (linkdown == 0) {
+        notice("PPPoE hangup");
+        status = EXIT_HANGUP;
     }
+    remove_fd(fd);
+    hungup = 1;
+    lcp_lowerdown(0);	/* PPPoE link is no longer available */
+    link_terminated(0);
 }
 
 /* ----------------------------------------------------------------------------- 
@@ -325,6 +325,14 @@ int pppoe_connect(int *errorcode)
         return errno;
     }
 
+    if (maxpayload) {
+        u_int16_t 	payload = maxpayload;
+        if (setsockopt(sockfd, PPPPROTO_PPPOE, PPPOE_OPT_MAX_PAYLOAD, &payload, 2)) {
+            error("PPPoE can't set PPPoE max payload...\n");
+            return errno;
+        }
+    }
+
     if (!strcmp(mode, MODE_ANSWER)) {
         // nothing to do
     }
@@ -345,7 +353,8 @@ int pppoe_connect(int *errorcode)
         }
         return -1;
     }
-    
+
+    pppoe_use_max_payload();
     return sockfd;
 }
 
@@ -370,6 +379,7 @@ close the socket descriptors
 void pppoe_close()
 {
 	if (sockfd >= 0) {
+		remove_fd(sockfd);
 		close(sockfd);
 		sockfd = -1;
 	}
@@ -399,8 +409,8 @@ int pppoe_establish_ppp(int fd)
     if (new_fd == -1)
         return -1;
 
-    /* add our pppoe socket to the select */
-    add_fd(fd);
+    /* add our pppoe socket to the select, wait_input calls us back when it's ready */
+    add_fd_handler(fd, pppoe_sock_ready, NULL);
     
     return new_fd;
 }
@@ -548,6 +558,29 @@ int pppoe_listen()
     return 0;
 }
 
+/* -----------------------------------------------------------------------------
+if the discovery agreed on a PPP-Max-Payload above the standard 1492 bytes,
+let LCP negotiate it as our MRU and accept it as our MTU
+----------------------------------------------------------------------------- */
+void pppoe_use_max_payload()
+{
+    u_int16_t 	payload;
+    socklen_t	len = sizeof(payload);
+
+    if (getsockopt(sockfd, PPPPROTO_PPPOE, PPPOE_OPT_MAX_PAYLOAD, &payload, &len) == -1) {
+        warning("PPPoE cannot retrieve max payload, %m");
+        return;
+    }
+
+    if (payload <= lcp_allowoptions[0].mru)
+        return;
+
+    notice("PPPoE max payload %d negotiated.", payload);
+    lcp_wantoptions[0].mru = payload;
+    lcp_wantoptions[0].neg_mru = 1;
+    lcp_allowoptions[0].mru = payload;
+}
+
 /* -----------------------------------------------------------------------------
 ----------------------------------------------------------------------------- */
 void closeall()
@@ -47,6 +47,7 @@
 #define PPP_LINK_ASYNC		0x00000002	/* link does asynchronous framing */
 #define PPP_LINK_ERRORDETECT	0x00000004	/* link does error detection */
 #define PPP_LINK_OOB_QUEUE	0x00000008	/* link support out-of-band priority queue */
+#define PPP_LINK_BATCH		0x00000010	/* link accepts a packet chain (mbuf_nextpkt) in lk_output */
 
 
 /* miscellaneous debug flags */
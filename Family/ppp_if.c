@@ -80,6 +80,8 @@ Includes
 Definitions
 ----------------------------------------------------------------------------- */
 
+#define PPP_IF_BATCH_MAX	32		/* max packets given at once to a PPP_LINK_BATCH link */
+
 /* -----------------------------------------------------------------------------
 Forward declarations
 ----------------------------------------------------------------------------- */
@@ -1418,7 +1420,8 @@ int ppp_if_xmit(ifnet_t ifp, mbuf_t m)
 {
     struct ppp_if 	*wan = ifnet_softc(ifp);
     struct ppp_link	*link;
-    int 		error = 0, len;
+    int 		error = 0, len, nb = 1;
+    u_int32_t		oerrors;
 	struct		ifnet_stat_increment_param statsinc;
 	
 	lck_mtx_assert(ppp_domain_mutex, LCK_MTX_ASSERT_OWNED);
@@ -1428,6 +1431,7 @@ int ppp_if_xmit(ifnet_t ifp, mbuf_t m)
 
     while (m) {
 
+        nb = 1;
         link = TAILQ_FIRST(&wan->link_head);
         if (link == 0) {
             LOGDBG(ifp, ("ppp%d: Trying to send data with link detached\n", ifnet_unit(ifp)));
@@ -1453,13 +1457,30 @@ int ppp_if_xmit(ifnet_t ifp, mbuf_t m)
         // we can not assume the state of the mbuf when we return
         len = (int)mbuf_len(m);
 
+        // the link can take several packets at once.
+        // the chain is bounded, so that lk_flags are tested again between chains
+        if (link->lk_support & PPP_LINK_BATCH) {
+            mbuf_t	last = m, m1;
+            while (nb < PPP_IF_BATCH_MAX && (m1 = ppp_dequeue(&wan->sndq))) {
+                mbuf_setnextpkt(last, m1);
+                last = m1;
+                nb++;
+            }
+        }
+
         // since we tested the lk_flags, ppp_link_send should not failed
         // except if there is a dramatic error
+        oerrors = link->lk_oerrors;
         link->lk_flags |= SC_XMIT_BUSY;
         error = ppp_link_send(link, m);
         link->lk_flags &= ~SC_XMIT_BUSY;
         if (error) {
-            // packet has been freed by link lower layer
+            // packet has been freed by link lower layer.
+            // a batch link may have sent part of the chain, and counts the
+            // packets it lost in lk_oerrors. otherwise the whole chain is lost
+            oerrors = link->lk_oerrors - oerrors;
+            if (oerrors > 0 && oerrors < (u_int32_t)nb)
+                nb = oerrors;
 			m = 0;
 			goto flush;
         }
@@ -1472,15 +1493,16 @@ int ppp_if_xmit(ifnet_t ifp, mbuf_t m)
 flush:
 
 	ifnet_touch_lastchange(ifp);
-	do {
-		bzero(&statsinc, sizeof(statsinc));
-		statsinc.errors_out = 1;
-		ifnet_stat_increment(ifp, &statsinc);
-		if (m)
-			mbuf_freem(m);
-		m = ppp_dequeue(&wan->sndq);
+	// one error for each packet lost, nb for the packet or chain that failed
+	bzero(&statsinc, sizeof(statsinc));
+	statsinc.errors_out = nb;
+	if (m)
+		mbuf_freem(m);
+	while ((m = ppp_dequeue(&wan->sndq))) {
+		statsinc.errors_out++;
+		mbuf_freem(m);
 	}
-	while (m);
+	ifnet_stat_increment(ifp, &statsinc);
 	return error;
 }
 
@@ -93,6 +93,7 @@ struct ppp_priv {
 Forward declarations
 ----------------------------------------------------------------------------- */
 
+static int ppp_link_frame(struct ppp_link *link, mbuf_t *mp);
 
 
 /* -----------------------------------------------------------------------------
@@ -393,14 +394,47 @@ void ppp_link_detachclient(struct ppp_link *link, void *host)
 we wend packet without link framing (FF03)
 it's the reponsability of the driver to add the header, it the links need it.
 it should be done accordingly to the ppp negociation as well.
+m can be a chain of packets if the link supports PPP_LINK_BATCH, 
+the whole chain is then given to the link in a single call
 ----------------------------------------------------------------------------- */
 int ppp_link_send(struct ppp_link *link, mbuf_t m)
 {
-    u_char 	*p = mbuf_data(m);	// no alignment issue as p is *uchar.
-    u_int16_t 	proto = ((u_int16_t)p[0] << 8) + p[1];
+    mbuf_t	head = 0, last = 0, next;
+    int		error;
 	
 	lck_mtx_assert(ppp_domain_mutex, LCK_MTX_ASSERT_OWNED);
 
+    while (m) {
+        next = mbuf_nextpkt(m);
+        mbuf_setnextpkt(m, 0);
+        if ((error = ppp_link_frame(link, &m))) {
+            // m has been freed, drop the rest of the chain as well
+            if (next)
+                mbuf_freem_list(next);
+            if (head)
+                mbuf_freem_list(head);
+            return error;
+        }
+        if (last)
+            mbuf_setnextpkt(last, m);
+        else
+            head = m;
+        last = m;
+        m = next;
+    }
+
+    return (*link->lk_output)(link, head);
+}
+
+/* -----------------------------------------------------------------------------
+prepare a single packet for the link, according to the ppp negociation
+----------------------------------------------------------------------------- */
+static int ppp_link_frame(struct ppp_link *link, mbuf_t *mp)
+{
+    mbuf_t	m = *mp;
+    u_char 	*p = mbuf_data(m);	// no alignment issue as p is *uchar.
+    u_int16_t 	proto = ((u_int16_t)p[0] << 8) + p[1];
+
     // if pcomp has been negociated, remove leading 0 byte
     if ((link->lk_flags & SC_COMP_PROT) && !p[0]) {
 	mbuf_adj(m, 1);
@@ -411,8 +445,10 @@ int ppp_link_send(struct ppp_link *link, mbuf_t m)
         if ((proto == PPP_LCP)
             || !(link->lk_flags & SC_COMP_AC)) {
         
-        if (mbuf_prepend(&m, 2, MBUF_DONTWAIT) != 0) 
+        if (mbuf_prepend(&m, 2, MBUF_DONTWAIT) != 0) {
+            *mp = 0;
             return ENOBUFS;
+        }
         
         p = mbuf_data(m);
         p[0] = PPP_ALLSTATIONS;
@@ -428,7 +464,8 @@ int ppp_link_send(struct ppp_link *link, mbuf_t m)
 		(link->lk_support & PPP_LINK_OOB_QUEUE))
 		mbuf_settype(m, MBUF_TYPE_OOBDATA);
 		
-    return (*link->lk_output)(link, m);
+    *mp = m;
+    return 0;
 }
 
 /* -----------------------------------------------------------------------------
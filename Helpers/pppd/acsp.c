@@ -424,8 +424,20 @@ typedef struct acsp_route {
     struct in_addr		router;
     u_int16_t			flags;
     int				installed;
+    int				covered;	// duplicate of another route, not installed
 } acsp_route;
 
+//
+// sort key used to find duplicate routes before installing them
+//
+typedef struct acsp_route_key {
+    acsp_route			*route;
+    u_int32_t			address;	// host order
+    u_int32_t			mask;		// host order
+    int				kind;		// ACSP_ROUTEFLAGS_PRIVATE or ACSP_ROUTEFLAGS_PUBLIC
+    int				index;		// position in the route list
+} acsp_route_key;
+
 // structure of route data in a packet
 typedef struct acsp_route_data {
     u_int32_t		address;
@@ -506,6 +518,8 @@ extern int publish_dns_wins_entry(CFStringRef entity, CFStringRef property1, CFT
 						CFStringRef property4, CFStringRef ref4, int clean);
 extern int route_interface(int cmd, struct in_addr host, struct in_addr mask, char iftype, char *ifname, int is_host);
 extern int route_gateway(int cmd, struct in_addr dest, struct in_addr mask, struct in_addr gateway, int use_gway_flag);
+extern void route_batch_begin(void);
+extern void route_batch_end(void);
 
 //
 // funtion prototypes
@@ -528,6 +542,7 @@ static void acsp_plugin_process __P((void *context, ACSP_Input *acsp_in, ACSP_Ou
 static void acsp_plugin_print_packet __P((void (*printer)(void *, char *, ...), void *arg, u_char code, char *inbuf, int insize));
 
 static void acsp_plugin_add_routes(acsp_route *route);
+static void acsp_plugin_compact_routes(acsp_route *list);
 static void acsp_plugin_add_domains(acsp_domain	*domain);
 static void acsp_plugin_remove_routes(acsp_route *route);
 
@@ -1342,7 +1357,14 @@ static void acsp_plugin_add_routes(acsp_route *route)
         }    
 #endif
         
+        acsp_plugin_compact_routes(route);
+        route_batch_begin();
         while (route) {
+            if (route->covered) {
+                route->installed = 0;
+                route = route->next;
+                continue;
+            }
             route->installed = 1;
             if (route->flags & ACSP_ROUTEFLAGS_PRIVATE) {
 				if (route->address.s_addr == 0)
@@ -1352,8 +1374,9 @@ static void acsp_plugin_add_routes(acsp_route *route)
 					//	err = route_gateway(RTM_ADD, route->address, route->mask, route->router, 1);
 					//else 
 						err = route_interface(RTM_ADD, route->address, route->mask, IFT_PPP, ifname, 0);
+					// failures are reported once by route_batch_end, the detail is for debugging
 					if (err == 0) {
-						error("ACSP plugin: error installing private net route. (%s/%s).",
+						dbglog("ACSP plugin: error installing private net route. (%s/%s).",
 							  addr2ascii(AF_INET, &route->address, sizeof(route->address), route_str),
 							  addr2ascii(AF_INET, &route->mask, sizeof(route->mask), mask_str));
 						route->installed = 0;
@@ -1364,7 +1387,7 @@ static void acsp_plugin_add_routes(acsp_route *route)
 					cifdefaultroute(0, 0, 0);
 				else {
 					if (route_gateway(RTM_ADD, route->address, route->mask, primary_router, 1) == 0) {
-						error("ACSP plugin: error installing public net route. (%s/%s -> %s).",
+						dbglog("ACSP plugin: error installing public net route. (%s/%s -> %s).",
 							  addr2ascii(AF_INET, &route->address, sizeof(route->address), route_str),
 							  addr2ascii(AF_INET, &route->mask, sizeof(route->mask), mask_str),
 							  addr2ascii(AF_INET, &primary_router, sizeof(primary_router), gateway_str));
@@ -1374,7 +1397,78 @@ static void acsp_plugin_add_routes(acsp_route *route)
             }
             route = route->next;
         }
+        route_batch_end();
+    }
+}
+
+//------------------------------------------------------------
+// acsp_route_compare
+//	order route keys by address, mask and kind,
+//	and by position in the list, so duplicates follow the first one
+//------------------------------------------------------------
+static int acsp_route_compare(const void *a, const void *b)
+{
+    const acsp_route_key *ka = a, *kb = b;
+
+    if (ka->address != kb->address)
+        return (ka->address < kb->address) ? -1 : 1;
+    if (ka->mask != kb->mask)
+        return (ka->mask < kb->mask) ? -1 : 1;
+    if (ka->kind != kb->kind)
+        return ka->kind - kb->kind;
+    return ka->index - kb->index;
+}
+
+//------------------------------------------------------------
+// acsp_plugin_compact_routes
+//	mark the routes pushed more than once with the same
+//	address, mask and kind: only the first one is installed,
+//	the others would just fail with EEXIST.
+//	routes are never merged or dropped for being inside
+//	another one, as that would change how traffic is routed
+//	against the routes already in the kernel
+//------------------------------------------------------------
+static void acsp_plugin_compact_routes(acsp_route *list)
+{
+    acsp_route_key	*keys, *key;
+    acsp_route		*route;
+    int			count = 0, i, kept;
+
+    for (route = list; route; route = route->next) {
+        route->covered = 0;
+        count++;
+    }
+    if (count < 2)
+        return;
+
+    keys = (acsp_route_key*)malloc(count * sizeof(acsp_route_key));
+    if (keys == 0)
+        return;		// not fatal, install the routes as they are
+
+    count = 0;
+    for (route = list; route; route = route->next) {
+        if (route->address.s_addr == 0 || (route->flags & (ACSP_ROUTEFLAGS_PRIVATE | ACSP_ROUTEFLAGS_PUBLIC)) == 0)
+            continue;
+        key = &keys[count++];
+        key->route = route;
+        key->address = ntohl(route->address.s_addr);
+        key->mask = ntohl(route->mask.s_addr);
+        key->kind = (route->flags & ACSP_ROUTEFLAGS_PRIVATE) ? ACSP_ROUTEFLAGS_PRIVATE : ACSP_ROUTEFLAGS_PUBLIC;
+        key->index = count - 1;
+    }
+    qsort(keys, count, sizeof(acsp_route_key), acsp_route_compare);
+
+    for (kept = count, i = 1; i < count; i++) {
+        if (keys[i].address == keys[i - 1].address && keys[i].mask == keys[i - 1].mask
+            && keys[i].kind == keys[i - 1].kind) {
+            keys[i].route->covered = 1;
+            kept--;
+        }
     }
+    if (kept < count)
+        dbglog("ACSP plugin: %d duplicate routes not installed", count - kept);
+
+    free(keys);
 }
 
 //------------------------------------------------------------
@@ -1387,6 +1481,7 @@ static void acsp_plugin_remove_routes(acsp_route *route)
 	char   mask_str[INET_ADDRSTRLEN];
 	char   gateway_str[INET_ADDRSTRLEN];
 	
+    route_batch_begin();
     while (route) {
         if (route->installed) {
 			route->installed = 0;
@@ -1418,6 +1513,7 @@ static void acsp_plugin_remove_routes(acsp_route *route)
 		}
         route = route->next;
     }
+    route_batch_end();
 }
 
 //------------------------------------------------------------
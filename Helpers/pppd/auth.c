@@ -166,7 +166,7 @@ int auth_done[NUM_PPP];
 static int logged_in;
 
 /* List of addresses which the peer may use. */
-static struct permitted_ip *addresses[NUM_PPP];
+static struct ip_trie *addresses[NUM_PPP];
 
 /* Wordlist giving addresses which the peer may use
    without authenticating itself. */
@@ -311,11 +311,26 @@ static int  have_chap_secret __P((char *, char *, int, int *));
 static int  have_srp_secret __P((char *client, char *server, int need_ip,
     int *lacks_ipp));
 #endif
-static int  ip_addr_check __P((u_int32_t, struct permitted_ip *));
+struct ip_trie;
+static int  ip_addr_check __P((u_int32_t, struct ip_trie *));
+static struct ip_trie *ip_trie_build __P((struct permitted_ip *, int));
 static int  scan_authfile __P((FILE *, char *, char *, char *,
 			       struct wordlist **, struct wordlist **,
 			       char *, int));
 static void free_wordlist __P((struct wordlist *));
+struct secrets_file;
+struct secret_entry;
+static unsigned secrets_hash __P((char *));
+static int  secrets_same_file __P((struct stat *, struct stat *));
+static void secrets_clear __P((struct secrets_file *));
+static void secrets_add __P((struct secrets_file *, char *, char *, char *, off_t,
+			     struct wordlist *, int *));
+static void secrets_index __P((struct secrets_file *));
+static void secrets_parse __P((struct secrets_file *, FILE *, char *));
+static struct secrets_file *secrets_get __P((FILE *, char *, int *));
+static struct secret_entry *secrets_next __P((struct secrets_file *, char *,
+			     struct secret_entry *, struct secret_entry **,
+			     struct secret_entry **));
 static void auth_script __P((char *));
 static void auth_script_done __P((void *));
 static void set_allowed_addrs __P((int, struct wordlist *, struct wordlist *));
@@ -2386,7 +2401,8 @@ set_allowed_addrs(unit, addrs, opts)
     ip[n].base = 0;		/* to terminate the list */
     ip[n].mask = 0;
 
-    addresses[unit] = ip;
+    addresses[unit] = ip_trie_build(ip, n + 1);
+    free(ip);
 
     /*
      * If the address given for the peer isn't authorized, or if
@@ -2444,14 +2460,152 @@ auth_ip_addr(unit, addr)
     return allow_any_ip || privileged || !have_route_to(addr);
 }
 
+/*
+ * Allowed addresses are kept in a path compressed binary trie of
+ * prefixes, built once when the list is set.  Each node remembers the
+ * first list entry with its prefix; a lookup walks down the address and
+ * keeps the earliest entry covering it, which is what a scan of the
+ * list in order would find.
+ */
+struct ip_node {
+    u_int32_t	prefix;		/* host byte order, masked to len bits */
+    int		len;		/* prefix length, 0 to 32 */
+    int		index;		/* first list entry for prefix, -1 if none */
+    int		permit;
+    int		child[2];	/* node indexes, 0 for none */
+};
+
+struct ip_trie {
+    int			count;		/* nodes in use */
+    struct ip_node	nodes[1];	/* nodes[0] is the root, 0/0 */
+};
+
+#define IP_PREFIX_MASK(len)	((len) == 0? 0: ~(u_int32_t)0 << (32 - (len)))
+#define IP_PREFIX_BIT(a, n)	(((a) >> (31 - (n))) & 1)
+
+static int
+ip_trie_node(t, prefix, len, index, permit)
+    struct ip_trie *t;
+    u_int32_t prefix;
+    int len, index, permit;
+{
+    struct ip_node *np = &t->nodes[t->count];
+
+    np->prefix = prefix & IP_PREFIX_MASK(len);
+    np->len = len;
+    np->index = index;
+    np->permit = permit;
+    np->child[0] = np->child[1] = 0;
+    return t->count++;
+}
+
+/*
+ * ip_trie_insert - add list entry `index' for prefix/len.
+ * Entries are added in list order, so the first one for a prefix stays.
+ */
+static void
+ip_trie_insert(t, prefix, len, index, permit)
+    struct ip_trie *t;
+    u_int32_t prefix;
+    int len, index, permit;
+{
+    struct ip_node *np, *cp;
+    int n, c, b, common, inner;
+    u_int32_t diff;
+
+    prefix &= IP_PREFIX_MASK(len);
+    for (n = 0; ; n = c) {
+	np = &t->nodes[n];
+	if (np->len == len) {
+	    if (np->index < 0) {
+		np->index = index;
+		np->permit = permit;
+	    }
+	    return;
+	}
+	b = IP_PREFIX_BIT(prefix, np->len);
+	c = np->child[b];
+	if (c == 0) {
+	    c = ip_trie_node(t, prefix, len, index, permit);
+	    t->nodes[n].child[b] = c;
+	    return;
+	}
+
+	/* how much of the child's prefix do we share? */
+	cp = &t->nodes[c];
+	common = MIN(len, cp->len);
+	diff = (prefix ^ cp->prefix) & IP_PREFIX_MASK(common);
+	if (diff != 0)
+	    for (common = 0; !(diff & 0x80000000); diff <<= 1)
+		common++;
+	if (common == cp->len)
+	    continue;		/* the child is a prefix of ours, go down */
+
+	if (common == len) {
+	    /* we are a prefix of the child, take its place */
+	    inner = ip_trie_node(t, prefix, len, index, permit);
+	} else {
+	    /* branch where the prefixes differ */
+	    inner = ip_trie_node(t, prefix, common, -1, 0);
+	    t->nodes[inner].child[IP_PREFIX_BIT(prefix, common)] =
+		ip_trie_node(t, prefix, len, index, permit);
+	}
+	t->nodes[inner].child[IP_PREFIX_BIT(t->nodes[c].prefix, common)] = c;
+	t->nodes[n].child[b] = inner;
+	return;
+    }
+}
+
+/*
+ * ip_trie_build - make the trie for a list of n permitted_ip entries.
+ */
+static struct ip_trie *
+ip_trie_build(ip, n)
+    struct permitted_ip *ip;
+    int n;
+{
+    struct ip_trie *t;
+    u_int32_t mask;
+    int i, len;
+
+    /* each entry adds at most a leaf and a branch */
+    t = (struct ip_trie *) malloc(sizeof(struct ip_trie)
+				  + 2 * n * sizeof(struct ip_node));
+    if (t == NULL)
+	return NULL;
+    t->count = 0;
+    ip_trie_node(t, 0, 0, -1, 0);
+
+    for (i = 0; i < n; i++) {
+	mask = ntohl(ip[i].mask);
+	for (len = 0; len < 32 && (mask & (0x80000000 >> len)); len++)
+	    ;
+	ip_trie_insert(t, ntohl(ip[i].base), len, i, ip[i].permit);
+    }
+    return t;
+}
+
 static int
-ip_addr_check(addr, addrs)
+ip_addr_check(addr, t)
     u_int32_t addr;
-    struct permitted_ip *addrs;
+    struct ip_trie *t;
 {
-    for (; ; ++addrs)
-	if ((addr & addrs->mask) == addrs->base)
-	    return addrs->permit;
+    struct ip_node *np;
+    int n, best = -1, permit = 0;
+
+    addr = ntohl(addr);
+    for (n = 0; ; ) {
+	np = &t->nodes[n];
+	if ((addr & IP_PREFIX_MASK(np->len)) != np->prefix)
+	    break;
+	if (np->index >= 0 && (best < 0 || np->index < best)) {
+	    best = np->index;
+	    permit = np->permit;
+	}
+	if (np->len == 32 || (n = np->child[IP_PREFIX_BIT(addr, np->len)]) == 0)
+	    break;
+    }
+    return permit;
 }
 
 /*
@@ -2540,6 +2694,359 @@ check_access(f, filename)
 }
 
 
+/*
+ * Secrets files are parsed once into memory and kept until they change.
+ * Each entry keeps its words as read by getword, in file order, and
+ * entries are indexed by client name so that a lookup only looks at
+ * the entries for that client and the wildcard ones.
+ * The secrets themselves are not kept: an entry records where its secret
+ * is in the file, and a lookup reads it again from there, along with
+ * indirect @/file secrets.  Only files that can't be checked for changes,
+ * parsed for a single lookup, keep their secrets in the entries.
+ */
+struct secret_entry {
+    struct secret_entry *hnext;		/* same client hash, in file order */
+    struct secret_entry *wnext;		/* wildcard clients, in file order */
+    int			order;		/* position in the file */
+    int			srp;		/* secret has two colons */
+    char		*client;
+    char		*server;
+    char		*secret;	/* NULL, unless the file is temporary */
+    off_t		secret_pos;	/* where the secret word starts in the file */
+    struct wordlist	*words;		/* addresses, "--" and options */
+};
+
+struct secrets_file {
+    struct secrets_file	*next;
+    char		*filename;
+    struct stat		st;		/* file the entries were read from */
+    int			racy;		/* read in the second it was modified */
+    int			tmp;		/* read for a single lookup, secrets kept */
+    int			count;
+    struct secret_entry	**entries;	/* all entries, in file order */
+    struct secret_entry	**hash;		/* non wildcard clients */
+    int			hash_size;	/* power of 2 */
+    struct secret_entry	*wild;		/* wildcard clients */
+};
+
+static struct secrets_file *secrets_files;
+
+static unsigned
+secrets_hash(name)
+    char *name;
+{
+    unsigned h = 2166136261U;
+
+    while (*name)
+	h = (h ^ (u_char)*name++) * 16777619U;
+    return h;
+}
+
+/*
+ * secrets_same_file - check whether the file is the one the entries
+ * were read from, and has not been modified since.
+ */
+static int
+secrets_same_file(a, b)
+    struct stat *a, *b;
+{
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino
+	&& a->st_size == b->st_size
+#ifdef __APPLE__
+	&& a->st_mtimespec.tv_sec == b->st_mtimespec.tv_sec
+	&& a->st_mtimespec.tv_nsec == b->st_mtimespec.tv_nsec
+	&& a->st_ctimespec.tv_sec == b->st_ctimespec.tv_sec
+	&& a->st_ctimespec.tv_nsec == b->st_ctimespec.tv_nsec;
+#else
+	&& a->st_mtime == b->st_mtime && a->st_ctime == b->st_ctime;
+#endif
+}
+
+/*
+ * secrets_clear - free the entries of a secrets file.
+ */
+static void
+secrets_clear(sf)
+    struct secrets_file *sf;
+{
+    struct secret_entry *ep;
+    int i;
+
+    for (i = 0; i < sf->count; i++) {
+	ep = sf->entries[i];
+	if (ep->secret != NULL)
+	    BZERO(ep->secret, strlen(ep->secret));
+	free_wordlist(ep->words);
+	free(ep);
+    }
+    if (sf->entries)
+	free(sf->entries);
+    if (sf->hash)
+	free(sf->hash);
+    sf->entries = sf->hash = NULL;
+    sf->count = sf->hash_size = 0;
+    sf->wild = NULL;
+}
+
+/*
+ * secrets_add - add an entry for a line of a secrets file.
+ */
+static void
+secrets_add(sf, client, server, secret, secret_pos, words, size)
+    struct secrets_file *sf;
+    char *client, *server, *secret;
+    off_t secret_pos;
+    struct wordlist *words;
+    int *size;
+{
+    struct secret_entry *ep;
+    char *cp;
+    int lc = (int)strlen(client) + 1;
+    int ls = (int)strlen(server) + 1;
+    int lk = sf->tmp? (int)strlen(secret) + 1: 0;
+
+    ep = (struct secret_entry *) malloc(sizeof(*ep) + lc + ls + lk);
+    if (ep == NULL)
+	novm("secrets cache");
+    ep->client = (char *) (ep + 1);
+    ep->server = ep->client + lc;
+    strlcpy(ep->client, client, lc);
+    strlcpy(ep->server, server, ls);
+    ep->secret = NULL;
+    if (sf->tmp) {
+	ep->secret = ep->server + ls;
+	strlcpy(ep->secret, secret, lk);
+    }
+    ep->secret_pos = secret_pos;
+    ep->srp = (cp = strchr(secret, ':')) != NULL && strchr(cp + 1, ':') != NULL;
+    ep->words = words;
+    ep->hnext = ep->wnext = NULL;
+    ep->order = sf->count;
+
+    if (sf->count == *size) {
+	*size = *size? *size * 2: 64;
+	sf->entries = realloc(sf->entries, *size * sizeof(ep));
+	if (sf->entries == NULL)
+	    novm("secrets cache");
+    }
+    sf->entries[sf->count++] = ep;
+}
+
+/*
+ * secrets_index - hash the entries by client, keeping file order
+ * within each chain.
+ */
+static void
+secrets_index(sf)
+    struct secrets_file *sf;
+{
+    struct secret_entry *ep, **wtail, **htail;
+    int i;
+
+    for (sf->hash_size = 16; sf->hash_size < sf->count; sf->hash_size *= 2)
+	;
+    sf->hash = (struct secret_entry **)
+	calloc(sf->hash_size, sizeof(struct secret_entry *));
+    if (sf->hash == NULL)
+	novm("secrets cache");
+
+    /* walk backwards and push, so that chains end up in file order */
+    wtail = &sf->wild;
+    for (i = sf->count - 1; i >= 0; i--) {
+	ep = sf->entries[i];
+	if (ISWILD(ep->client)) {
+	    ep->wnext = *wtail;
+	    *wtail = ep;
+	} else {
+	    htail = &sf->hash[secrets_hash(ep->client) & (sf->hash_size - 1)];
+	    ep->hnext = *htail;
+	    *htail = ep;
+	}
+    }
+}
+
+/*
+ * secrets_parse - read all the entries of a secrets file.
+ * An entry is a line with a client, a server and a secret,
+ * then optional addresses, "--" and options.  Lines with fewer
+ * words can never match and are ignored.
+ */
+static void
+secrets_parse(sf, f, filename)
+    struct secrets_file *sf;
+    FILE *f;
+    char *filename;
+{
+    int newline, size = 0;
+    off_t secret_pos;
+    struct wordlist *ap, *alist, **app;
+    char word[MAXWORDLEN];
+    char client[MAXWORDLEN];
+    char server[MAXWORDLEN];
+    char secret[MAXWORDLEN];
+
+    if (!getword(f, word, &newline, filename))
+	goto done;		/* file is empty??? */
+    newline = 1;
+    for (;;) {
+	/*
+	 * Skip until we find a word at the start of a line.
+	 */
+	while (!newline && getword(f, word, &newline, filename))
+	    ;
+	if (!newline)
+	    break;		/* got to end of file */
+	strlcpy(client, word, sizeof(client));
+
+	if (!getword(f, word, &newline, filename))
+	    break;
+	if (newline)
+	    continue;
+	strlcpy(server, word, sizeof(server));
+
+	secret_pos = ftello(f);
+	if (!getword(f, word, &newline, filename))
+	    break;
+	if (newline)
+	    continue;
+	strlcpy(secret, word, sizeof(secret));
+
+	/*
+	 * Now read address authorization info and make a wordlist.
+	 */
+	app = &alist;
+	for (;;) {
+	    if (!getword(f, word, &newline, filename) || newline)
+		break;
+		int	len = (int)strlen(word) + 1;
+	    ap = (struct wordlist *)
+		    malloc(sizeof(struct wordlist) + len);
+	    if (ap == NULL)
+		novm("authorized addresses");
+	    ap->word = (char *) (ap + 1);
+	    strlcpy(ap->word, word, len);
+	    *app = ap;
+	    app = &ap->next;
+	}
+	*app = NULL;
+
+	secrets_add(sf, client, server, secret, secret_pos, alist, &size);
+	BZERO(secret, sizeof(secret));
+
+	if (!newline)
+	    break;
+    }
+
+done:
+    secrets_index(sf);
+}
+
+/*
+ * secrets_get - return the entries of the secrets file open on f,
+ * reading them again if the file has changed.  Files that can't be
+ * checked for changes are read into a temporary set, *tmp is then set.
+ */
+static struct secrets_file *
+secrets_get(f, filename, tmp)
+    FILE *f;
+    char *filename;
+    int *tmp;
+{
+    struct secrets_file *sf;
+    struct stat st;
+    int l;
+
+    *tmp = 0;
+    if (fstat(fileno(f), &st) < 0 || !S_ISREG(st.st_mode)) {
+	sf = (struct secrets_file *) calloc(1, sizeof(*sf));
+	if (sf == NULL)
+	    novm("secrets cache");
+	sf->tmp = 1;
+	secrets_parse(sf, f, filename);
+	*tmp = 1;
+	return sf;
+    }
+
+    for (sf = secrets_files; sf != NULL; sf = sf->next)
+	if (strcmp(sf->filename, filename) == 0)
+	    break;
+    if (sf == NULL) {
+	l = (int)strlen(filename) + 1;
+	sf = (struct secrets_file *) calloc(1, sizeof(*sf) + l);
+	if (sf == NULL)
+	    novm("secrets cache");
+	sf->filename = (char *) (sf + 1);
+	strlcpy(sf->filename, filename, l);
+	sf->next = secrets_files;
+	secrets_files = sf;
+    } else if (sf->hash != NULL && !sf->racy && secrets_same_file(&sf->st, &st))
+	return sf;
+
+    secrets_clear(sf);
+    secrets_parse(sf, f, filename);
+    sf->st = st;
+    /* a change within the same timestamp tick would go unnoticed */
+    sf->racy = time(NULL) - st.st_mtime <= 1;
+    return sf;
+}
+
+/*
+ * secrets_next - next candidate entry for client, in file order:
+ * the entries for that client merged with the wildcard ones,
+ * or all of them if client is NULL.
+ */
+static struct secret_entry *
+secrets_next(sf, client, ep, hp, wp)
+    struct secrets_file *sf;
+    char *client;
+    struct secret_entry *ep, **hp, **wp;
+{
+    struct secret_entry *h, *w;
+
+    if (client == NULL) {
+	int i = ep? ep->order + 1: 0;
+	return i < sf->count? sf->entries[i]: NULL;
+    }
+
+    for (h = *hp; h != NULL && strcmp(h->client, client) != 0; h = h->hnext)
+	;
+    w = *wp;
+    if (h != NULL && (w == NULL || h->order < w->order)) {
+	*hp = h->hnext;
+	return h;
+    }
+    *hp = h;
+    if (w != NULL)
+	*wp = w->wnext;
+    return w;
+}
+
+/*
+ * secrets_read - get the secret of an entry into word (MAXWORDLEN bytes),
+ * reading it again from the file open on f if it isn't kept.
+ * Return 0 if it can't be read.
+ */
+static int
+secrets_read(sf, ep, f, word)
+    struct secrets_file *sf;
+    struct secret_entry *ep;
+    FILE *f;
+    char *word;
+{
+    int newline;
+
+    if (ep->secret != NULL) {
+	strlcpy(word, ep->secret, MAXWORDLEN);
+	return 1;
+    }
+    if (fseeko(f, ep->secret_pos, SEEK_SET) < 0
+	|| !getword(f, word, &newline, sf->filename)) {
+	warning("can't read secret again from %s", sf->filename);
+	return 0;
+    }
+    return 1;
+}
+
 /*
  * scan_authfile - Scan an authorization file for a secret suitable
  * for authenticating `client' on `server'.  The return value is -1
@@ -2551,9 +3058,11 @@ check_access(f, filename)
  * following words (extra options) are placed in a wordlist and
  * returned in *opts.
  * We assume secret is NULL or points to MAXWORDLEN bytes of space.
-  * Flags are non-zero if we need two colons in the secret in order to
+ * Flags are non-zero if we need two colons in the secret in order to
  * match.
-*/
+ * The file is read through the secrets cache, the first entry with the
+ * best match wins as if the file was scanned from the start.
+ */
 static int
 scan_authfile(f, client, server, secret, addrs, opts, filename, flags)
     FILE *f;
@@ -2565,53 +3074,45 @@ scan_authfile(f, client, server, secret, addrs, opts, filename, flags)
     char *filename;
     int flags;
 {
-    int newline, xxx;
+    int xxx, tmp, len, in_opts;
     int got_flag, best_flag;
     FILE *sf;
-    struct wordlist *ap, *addr_list, *alist, **app;
+    struct secrets_file *sfp;
+    struct secret_entry *ep, *best, *hnext, *wnext;
+    struct wordlist *ap, *wp, *addr_list, *opt_list, **app;
     char word[MAXWORDLEN];
     char atfile[MAXWORDLEN];
     char lsecret[MAXWORDLEN];
-    char *cp;
 
     if (addrs != NULL)
 	*addrs = NULL;
     if (opts != NULL)
 	*opts = NULL;
-    addr_list = NULL;
-    if (!getword(f, word, &newline, filename))
-	return -1;		/* file is empty??? */
-    newline = 1;
-    best_flag = -1;
-    for (;;) {
-	/*
-	 * Skip until we find a word at the start of a line.
-	 */
-	while (!newline && getword(f, word, &newline, filename))
-	    ;
-	if (!newline)
-	    break;		/* got to end of file */
+    sfp = secrets_get(f, filename, &tmp);
 
+    best = NULL;
+    best_flag = -1;
+    in_opts = 0;
+    hnext = wnext = NULL;
+    if (client != NULL) {
+	hnext = sfp->hash[secrets_hash(client) & (sfp->hash_size - 1)];
+	wnext = sfp->wild;
+    }
+    for (ep = NULL; (ep = secrets_next(sfp, client, ep, &hnext, &wnext)) != NULL; ) {
 	/*
 	 * Got a client - check if it's a match or a wildcard.
 	 */
 	got_flag = 0;
-	if (client != NULL && strcmp(word, client) != 0 && !ISWILD(word)) {
-	    newline = 0;
+	if (client != NULL && strcmp(ep->client, client) != 0 && !ISWILD(ep->client))
 	    continue;
-	}
-	if (!ISWILD(word))
+	if (!ISWILD(ep->client))
 	    got_flag = NONWILD_CLIENT;
 
 	/*
-	 * Now get a server and check if it matches.
+	 * Check if the server matches.
 	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-	if (!ISWILD(word)) {
-	    if (server != NULL && strcmp(word, server) != 0)
+	if (!ISWILD(ep->server)) {
+	    if (server != NULL && strcmp(ep->server, server) != 0)
 		continue;
 	    got_flag |= NONWILD_SERVER;
 	}
@@ -2623,23 +3124,16 @@ scan_authfile(f, client, server, secret, addrs, opts, filename, flags)
 	if (got_flag <= best_flag)
 	    continue;
 
-	/*
-	 * Get the secret.
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-
 	/*
 	 * SRP-SHA1 authenticator should never be reading secrets from
 	 * a file.  (Authenticatee may, though.)
 	 */
-	if (flags && ((cp = strchr(word, ':')) == NULL ||
-	    strchr(cp + 1, ':') == NULL))
+	if (flags && !ep->srp)
 	    continue;
 
 	if (secret != NULL) {
+	    if (!secrets_read(sfp, ep, f, word))
+		continue;
 	    /*
 	     * Special syntax: @/pathname means read secret from file.
 	     */
@@ -2658,60 +3152,54 @@ scan_authfile(f, client, server, secret, addrs, opts, filename, flags)
 		fclose(sf);
 	    }
 	    strlcpy(lsecret, word, sizeof(lsecret));
+	    BZERO(word, sizeof(word));
 	}
 
-	/*
-	 * Now read address authorization info and make a wordlist.
-	 */
-	app = &alist;
-	for (;;) {
-	    if (!getword(f, word, &newline, filename) || newline)
-		break;
-		int	len = (int)strlen(word) + 1;
-	    ap = (struct wordlist *)
-		    malloc(sizeof(struct wordlist) + len);
-	    if (ap == NULL)
-		novm("authorized addresses");
-	    ap->word = (char *) (ap + 1);
-	    strlcpy(ap->word, word, len);
-	    *app = ap;
-	    app = &ap->next;
-	}
-	*app = NULL;
-
 	/*
 	 * This is the best so far; remember it.
 	 */
 	best_flag = got_flag;
-	if (addr_list)
-	    free_wordlist(addr_list);
-	addr_list = alist;
+	best = ep;
 	if (secret != NULL)
 	    strlcpy(secret, lsecret, MAXWORDLEN);
-
-	if (!newline)
-	    break;
+	if (best_flag == (NONWILD_CLIENT | NONWILD_SERVER))
+	    break;		/* can't do better */
     }
-
-    /* scan for a -- word indicating the start of options */
-    for (app = &addr_list; (ap = *app) != NULL; app = &ap->next)
-	if (strcmp(ap->word, "--") == 0)
-	    break;
-    /* ap = start of options */
-    if (ap != NULL) {
-	ap = ap->next;		/* first option */
-	free(*app);			/* free the "--" word */
-	*app = NULL;		/* terminate addr list */
+    BZERO(lsecret, sizeof(lsecret));
+
+    /* copy the words, a "--" word indicates the start of options */
+    addr_list = opt_list = NULL;
+    app = &addr_list;
+    for (wp = best? best->words: NULL; wp != NULL; wp = wp->next) {
+	if (!in_opts && strcmp(wp->word, "--") == 0) {
+	    in_opts = 1;
+	    app = &opt_list;
+	    continue;
+	}
+	len = (int)strlen(wp->word) + 1;
+	ap = (struct wordlist *)
+		malloc(sizeof(struct wordlist) + len);
+	if (ap == NULL)
+	    novm("authorized addresses");
+	ap->word = (char *) (ap + 1);
+	ap->next = NULL;
+	strlcpy(ap->word, wp->word, len);
+	*app = ap;
+	app = &ap->next;
     }
     if (opts != NULL)
-	*opts = ap;
-    else if (ap != NULL)
-	free_wordlist(ap);
+	*opts = opt_list;
+    else if (opt_list != NULL)
+	free_wordlist(opt_list);
     if (addrs != NULL)
 	*addrs = addr_list;
     else if (addr_list != NULL)
 	free_wordlist(addr_list);
 
+    if (tmp) {
+	secrets_clear(sfp);
+	free(sfp);
+    }
     return best_flag;
 }
 
@@ -516,11 +516,14 @@ NewPasswordEncryptedWithOldNtPasswordHash(u_char *NewPassword, int NewPasswordLe
 static void
 NtPasswordHashEncryptedWithBlock(u_char *PasswordHash, u_char *Block, u_char *Cypher)
 {
-    (void) DesSetkey(Block + 0);
-    DesEncrypt(PasswordHash, Cypher + 0);
+    des_context	ctx;
+
+    (void) DesSetkeyContext(&ctx, Block + 0);
+    DesEncryptContext(&ctx, PasswordHash, Cypher + 0);
 	
-    (void) DesSetkey(Block + 7);
-    DesEncrypt(PasswordHash + 8, Cypher + 8);
+    (void) DesSetkeyContext(&ctx, Block + 7);
+    DesEncryptContext(&ctx, PasswordHash + 8, Cypher + 8);
+    DesClearkey(&ctx);
 }
 
 static void
@@ -814,6 +817,7 @@ ChallengeResponse(u_char *challenge,
 		  u_char response[24])
 {
     u_char    ZPasswordHash[21];
+    des_context	ctx;
 
     BZERO(ZPasswordHash, sizeof(ZPasswordHash));
     BCOPY(PasswordHash, ZPasswordHash, MD4_SIGNATURE_SIZE);
@@ -823,12 +827,13 @@ ChallengeResponse(u_char *challenge,
 	   sizeof(ZPasswordHash), ZPasswordHash);
 #endif
 
-    (void) DesSetkey(ZPasswordHash + 0);
-    DesEncrypt(challenge, response + 0);
-    (void) DesSetkey(ZPasswordHash + 7);
-    DesEncrypt(challenge, response + 8);
-    (void) DesSetkey(ZPasswordHash + 14);
-    DesEncrypt(challenge, response + 16);
+    (void) DesSetkeyContext(&ctx, ZPasswordHash + 0);
+    DesEncryptContext(&ctx, challenge, response + 0);
+    (void) DesSetkeyContext(&ctx, ZPasswordHash + 7);
+    DesEncryptContext(&ctx, challenge, response + 8);
+    (void) DesSetkeyContext(&ctx, ZPasswordHash + 14);
+    DesEncryptContext(&ctx, challenge, response + 16);
+    DesClearkey(&ctx);
 
 #if 0
     dbglog("ChallengeResponse - response %.24B", response);
@@ -945,15 +950,17 @@ ChapMS_LANMan(u_char *rchallenge, char *secret, int secret_len,
     int			i;
     u_char		UcasePassword[MAX_NT_PASSWORD]; /* max is actually 14 */
     u_char		PasswordHash[MD4_SIGNATURE_SIZE];
+    des_context		ctx;
 
     /* LANMan password is case insensitive */
     BZERO(UcasePassword, sizeof(UcasePassword));
     for (i = 0; i < secret_len; i++)
        UcasePassword[i] = (u_char)toupper(secret[i]);
-    (void) DesSetkey(UcasePassword + 0);
-    DesEncrypt( StdText, PasswordHash + 0 );
-    (void) DesSetkey(UcasePassword + 7);
-    DesEncrypt( StdText, PasswordHash + 8 );
+    (void) DesSetkeyContext(&ctx, UcasePassword + 0);
+    DesEncryptContext(&ctx, StdText, PasswordHash + 0 );
+    (void) DesSetkeyContext(&ctx, UcasePassword + 7);
+    DesEncryptContext(&ctx, StdText, PasswordHash + 8 );
+    DesClearkey(&ctx);
     ChallengeResponse(rchallenge, PasswordHash, response->LANManResp);
 }
 #endif
@@ -92,8 +92,23 @@ int escape_flag;
 int flush_flag;
 int fcs;
 
+/*
+ * Packets held while the link comes up, in arrival order.
+ * The queue is bounded in packets and bytes.  Packets are spread
+ * over HOLD_FLOWS buckets by flow (addresses, protocol and ports):
+ * a flow can't hold more than demand_hold_flow packets, and when the
+ * queue is full the bucket holding the most loses its oldest packet,
+ * so that one chatty application can't push out everybody else.
+ * Packets opening a connection (TCP SYN, DNS queries) don't count
+ * against their flow, are never dropped to make room for ordinary
+ * packets and are sent first once the link is up.
+ */
+#define HOLD_FLOWS	64
+
 struct packet {
     int length;
+    short flow;			/* bucket, see hold_classify */
+    short prio;			/* opens a connection */
     struct packet *next;
     unsigned char data[1];
 };
@@ -101,7 +116,18 @@ struct packet {
 struct packet *pend_q;
 struct packet *pend_qtail;
 
+static int hold_count[HOLD_FLOWS];	/* ordinary packets held per bucket */
+static int hold_packets;		/* packets held */
+static int hold_bytes;			/* and their size */
+static struct {				/* since the queue was last emptied */
+    u_int32_t queued, prio, dropped, dropped_bytes;
+} hold_stats;
+
 static int active_packet __P((unsigned char *, int));
+static void hold_classify __P((unsigned char *, int, int *, int *));
+static int hold_evict __P((void));
+static void hold_unlink __P((struct packet *, struct packet *));
+static void hold_report __P((void));
 
 /*
  * demand_conf - configure the interface for doing dial-on-demand.
@@ -181,6 +207,10 @@ demand_discard()
 	free(pkt);
     }
     pend_q = NULL;
+    pend_qtail = NULL;
+    hold_packets = hold_bytes = 0;
+    memset(hold_count, 0, sizeof(hold_count));
+    hold_report();
     framelen = 0;
     flush_flag = 0;
     escape_flag = 0;
@@ -302,6 +332,7 @@ loop_frame(frame, len)
     int len;
 {
     struct packet *pkt;
+    int flow, prio;
 
     dbglog("Dial on demand: %P", frame, len);
     if (len < PPP_HDRLEN)
@@ -311,9 +342,28 @@ loop_frame(frame, len)
     if (!active_packet(frame, len))
 	return 0;
 
+    /* make room, or drop this one */
+    hold_classify(frame, len, &flow, &prio);
+    if ((!prio && hold_count[flow] >= demand_hold_flow)
+	|| len > demand_hold_bytes) {
+	++hold_stats.dropped;
+	hold_stats.dropped_bytes += len;
+	return 1;
+    }
+    while (hold_packets >= demand_hold_packets
+	   || hold_bytes + len > demand_hold_bytes) {
+	if (!hold_evict()) {
+	    ++hold_stats.dropped;
+	    hold_stats.dropped_bytes += len;
+	    return 1;
+	}
+    }
+
     pkt = (struct packet *) malloc(sizeof(struct packet) + len);
     if (pkt != NULL) {
 	pkt->length = len;
+	pkt->flow = flow;
+	pkt->prio = prio;
 	pkt->next = NULL;
 	memcpy(pkt->data, frame, len);
 	if (pend_q == NULL)
@@ -321,39 +371,189 @@ loop_frame(frame, len)
 	else
 	    pend_qtail->next = pkt;
 	pend_qtail = pkt;
+	++hold_packets;
+	hold_bytes += len;
+	if (!prio)
+	    ++hold_count[flow];
+	++hold_stats.queued;
+	if (prio)
+	    ++hold_stats.prio;
     }
     return 1;
 }
 
+/*
+ * hold_unlink - take pkt, which follows prev, off the pending queue.
+ */
+static void
+hold_unlink(prev, pkt)
+    struct packet *prev, *pkt;
+{
+    if (prev == NULL)
+	pend_q = pkt->next;
+    else
+	prev->next = pkt->next;
+    if (pend_qtail == pkt)
+	pend_qtail = prev;
+    --hold_packets;
+    hold_bytes -= pkt->length;
+    if (!pkt->prio)
+	--hold_count[pkt->flow];
+}
+
+/*
+ * hold_evict - drop the oldest ordinary packet of the busiest flow.
+ * Return 0 if only connection opening packets are left: these
+ * are not dropped to make room for later ones.
+ */
+static int
+hold_evict()
+{
+    struct packet *pkt, *prev;
+    int i, flow;
+
+    flow = 0;
+    for (i = 1; i < HOLD_FLOWS; ++i)
+	if (hold_count[i] > hold_count[flow])
+	    flow = i;
+    if (hold_count[flow] == 0)
+	return 0;
+
+    prev = NULL;
+    for (pkt = pend_q; pkt != NULL; prev = pkt, pkt = pkt->next)
+	if (!pkt->prio && pkt->flow == flow)
+	    break;
+    if (pkt == NULL)
+	return 0;		/* can't happen */
+    hold_unlink(prev, pkt);
+    ++hold_stats.dropped;
+    hold_stats.dropped_bytes += pkt->length;
+    free(pkt);
+    return 1;
+}
+
+/*
+ * hold_report - log what happened to the packets held
+ * while the link was coming up, once they are all gone.
+ */
+static void
+hold_report()
+{
+    if (hold_stats.queued == 0 && hold_stats.dropped == 0)
+	return;
+    if (hold_stats.dropped != 0)
+	info("Dial on demand: queued %u packets (%u opening connections), "
+	     "dropped %u packets (%u bytes)", hold_stats.queued, hold_stats.prio,
+	     hold_stats.dropped, hold_stats.dropped_bytes);
+    else
+	dbglog("Dial on demand: queued %u packets (%u opening connections)",
+	       hold_stats.queued, hold_stats.prio);
+    memset(&hold_stats, 0, sizeof(hold_stats));
+}
+
 /*
  * demand_rexmit - Resend all those frames which we got via the
  * loopback, now that the real serial link is up.
+ * Packets opening a connection go first, the others follow in
+ * the order they came in.
  */
 void
 demand_rexmit(proto)
     int proto;
 {
     struct packet *pkt, *prev, *nextpkt;
+    int pass;
 
-    prev = NULL;
-    pkt = pend_q;
-    pend_q = NULL;
-    for (; pkt != NULL; pkt = nextpkt) {
-	nextpkt = pkt->next;
-	if (PPP_PROTOCOL(pkt->data) == proto) {
-	    output(0, pkt->data, pkt->length);
-	    free(pkt);
-	} else {
-	    if (prev == NULL)
-		pend_q = pkt;
-	    else
-		prev->next = pkt;
-	    prev = pkt;
+    for (pass = 1; pass >= 0; --pass) {
+	prev = NULL;
+	for (pkt = pend_q; pkt != NULL; pkt = nextpkt) {
+	    nextpkt = pkt->next;
+	    if (PPP_PROTOCOL(pkt->data) == proto && pkt->prio == pass) {
+		hold_unlink(prev, pkt);
+		output(0, pkt->data, pkt->length);
+		free(pkt);
+	    } else
+		prev = pkt;
 	}
     }
-    pend_qtail = prev;
-    if (prev != NULL)
-	prev->next = NULL;
+    if (pend_q == NULL)
+	hold_report();
+}
+
+/*
+ * hold_classify - find the bucket of the flow a packet belongs to,
+ * and whether it opens a connection: a TCP SYN or a DNS query.
+ * We use the macros below because the IP header may be at an odd
+ * address, see ip_active_pkt.
+ */
+#define net_short(x)	(((x)[0] << 8) + (x)[1])
+#define get_iphl(x)	(((unsigned char *)(x))[0] & 0xF)
+#define get_ipoff(x)	net_short((unsigned char *)(x) + 6)
+#define get_ipproto(x)	(((unsigned char *)(x))[9])
+#define get_tcpflags(x)	(((unsigned char *)(x))[13])
+#define IP_HDRLEN	20
+#define IP6_HDRLEN	40
+#define IP_OFFMASK	0x1fff
+#define TH_SYN		0x02
+#define TH_ACK		0x10
+#define DNS_PORT	53
+#ifndef IPPROTO_TCP
+#define IPPROTO_TCP	6
+#endif
+#ifndef IPPROTO_UDP
+#define IPPROTO_UDP	17
+#endif
+
+static void
+hold_classify(p, len, flowp, priop)
+    unsigned char *p;
+    int len;
+    int *flowp, *priop;
+{
+    u_int32_t h;
+    unsigned char *addrs, *l4;
+    int proto, naddrs, ipproto, hlen, i;
+
+    proto = PPP_PROTOCOL(p);
+    p += PPP_HDRLEN;
+    len -= PPP_HDRLEN;
+    addrs = l4 = NULL;
+    naddrs = ipproto = hlen = 0;
+    if (proto == PPP_IP && len >= IP_HDRLEN) {
+	addrs = p + 12;
+	naddrs = 8;
+	ipproto = get_ipproto(p);
+	hlen = get_iphl(p) * 4;
+	if ((get_ipoff(p) & IP_OFFMASK) == 0 && len >= hlen + 4)
+	    l4 = p + hlen;
+#ifdef PPP_IPV6
+    } else if (proto == PPP_IPV6 && len >= IP6_HDRLEN) {
+	addrs = p + 8;
+	naddrs = 32;
+	ipproto = p[6];		/* extension headers are not followed */
+	hlen = IP6_HDRLEN;
+	if (len >= hlen + 4)
+	    l4 = p + hlen;
+#endif
+    }
+    if (ipproto != IPPROTO_TCP && ipproto != IPPROTO_UDP)
+	l4 = NULL;
+
+    h = 2166136261U ^ proto ^ (ipproto << 16);
+    for (i = 0; i < naddrs; ++i)
+	h = (h ^ addrs[i]) * 16777619U;
+    for (i = 0; l4 != NULL && i < 4; ++i)
+	h = (h ^ l4[i]) * 16777619U;
+    *flowp = h % HOLD_FLOWS;
+
+    *priop = 0;
+    if (l4 == NULL)
+	return;
+    if (ipproto == IPPROTO_TCP)
+	*priop = len >= hlen + 14
+	    && (get_tcpflags(l4) & (TH_SYN | TH_ACK)) == TH_SYN;
+    else
+	*priop = net_short(l4 + 2) == DNS_PORT;
 }
 
 /*
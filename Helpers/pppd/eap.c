@@ -46,6 +46,8 @@
 #include <sys/time.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
 
 #include "pppd.h"
 #include "eap.h"
@@ -117,6 +119,34 @@ eap_state eap[NUM_PPP];		/* EAP state; one for each unit */
 
 eap_ext *eap_extensions = NULL;	/* eap extensions list */
 
+/*
+ * Work submitted by the plugins with async_submit.
+ * A few worker threads, created on demand, run the jobs, and report
+ * them to the main loop through a pipe, like the UI thread does.
+ * The workers don't survive a fork, when detach() runs after
+ * authentication (updetach) the child starts its own when needed.
+ */
+#define EAP_ASYNC_WORKERS	2	/* client and server can both be busy */
+
+typedef struct eap_job {
+    struct eap_job	*next;
+    eap_state		*cstate;
+    int			server;		/* submitted by the server extension */
+    void		(*work) __P((void *));
+    void		*arg;
+} eap_job;
+
+static pthread_mutex_t	eap_job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	eap_job_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	eap_job_finished = PTHREAD_COND_INITIALIZER;
+static eap_job	*eap_job_queue = NULL;	/* jobs waiting for a worker */
+static eap_job	*eap_job_done = NULL;	/* jobs run, not reported yet */
+static int	eap_job_workers = 0;	/* worker threads started */
+static int	eap_job_idle = 0;	/* worker threads waiting for a job */
+static int	eap_job_outstanding = 0; /* jobs submitted, not reported yet */
+static int	eap_job_fds[2] = { -1, -1 };	/* completion pipe */
+static int	eap_job_atfork = 0;	/* fork handlers installed */
+
 static void EapChallengeTimeout __P((void *));
 static void EapReceiveRequest __P((eap_state *, u_char *, int, u_char *, int, int));
 static void EapRechallenge __P((void *));
@@ -130,6 +160,12 @@ static int EAPClientProcess(eap_state *, u_int16_t, u_char *, int);
 static void EAPClientAction(eap_state *);
 static void EAPServerAction(eap_state *);
 static void EAPInput_fd(void);
+static int EapAsyncSubmit __P((EAP_Input *, void (*)(void *), void *));
+static void EapAsyncDone __P((void));
+static void EapAsyncCancel __P((eap_state *));
+static void EapAsyncForkPrepare __P((void));
+static void EapAsyncForkParent __P((void));
+static void EapAsyncForkChild __P((void));
 
 
 /*
@@ -366,6 +402,9 @@ EapLowerDown(unit)
     cstate->clientstate = EAPCS_INITIAL;
     cstate->serverstate = EAPSS_INITIAL;
 
+    /* the plugins can't be disposed while their work is running */
+    EapAsyncCancel(cstate);
+
     if (cstate->client_ext) {
         cstate->client_ext->dispose(cstate->client_ext_ctx);
         free (cstate->client_ext_input);
@@ -660,6 +699,7 @@ EapReceiveRequest(cstate, inpacket, packet_len, inp, id, len)
                 cstate->client_ext_input->password = cstate->password;
                 cstate->client_ext_input->log_debug = dbglog;
                 cstate->client_ext_input->log_error = error;
+                cstate->client_ext_input->async_submit = EapAsyncSubmit;
 
                 /* this part depends on the message */
             	cstate->client_ext_input->notification = EAP_NOTIFICATION_NONE; // no notification in the init message
@@ -706,6 +746,11 @@ EapReceiveResponse(cstate, inpacket, packet_len,  inp, id, len)
     if (id != cstate->req_id)
 	return;			/* doesn't match ID of last challenge */
 
+    if (cstate->server_ext_pending) {
+	EAPDEBUG(("EapReceiveResponse: plugin busy, response dropped."));
+	return;			/* the peer will retransmit */
+    }
+
     if (len < 1) {
 	EAPDEBUG(("EapReceiveResponse: rcvd short packet."));
 	return;
@@ -804,6 +849,7 @@ EapReceiveResponse(cstate, inpacket, packet_len,  inp, id, len)
             cstate->server_ext_input->password = 0; /* irrelevant in server mode */
             cstate->server_ext_input->log_debug = dbglog;
             cstate->server_ext_input->log_error = error;
+            cstate->server_ext_input->async_submit = EapAsyncSubmit;
  
             /* this part depends on the message */
             cstate->server_ext_input->notification = EAP_NOTIFICATION_NONE; // no notification in the init message
@@ -875,6 +921,11 @@ EAPClientProcess(eap_state *cstate, u_int16_t notification, u_char *inpacket, in
         /* ignore the request */
     	return 0;
 
+    if (cstate->client_ext_pending && notification != EAP_NOTIFICATION_ASYNC_DONE) {
+        EAPDEBUG(("EAPClientProcess: plugin busy, notification %d dropped.", notification));
+        return 0;
+    }
+
     /* setup in and out structures */
     cstate->client_ext_input->notification = notification;
     cstate->client_ext_input->data = inpacket;
@@ -951,7 +1002,8 @@ void EAPInput_fd(void)
         result = 0;
         read(cstate->client_ext_ui_fds[0], &result, 1);
         
-        wait_input_hook = 0;
+        if (eap_job_outstanding == 0)
+            wait_input_hook = 0;
         remove_fd(cstate->client_ext_ui_fds[0]);
         close(cstate->client_ext_ui_fds[0]);
         close(cstate->client_ext_ui_fds[1]);
@@ -966,6 +1018,9 @@ void EAPInput_fd(void)
 
         EAPClientProcess(cstate, EAP_NOTIFICATION_DATA_FROM_UI, cstate->client_ext_ui_data, cstate->client_ext_ui_data_len);
     }
+
+    if (eap_job_fds[0] != -1 && is_ready_fd(eap_job_fds[0]))
+        EapAsyncDone();
 }
 
 /*
@@ -1016,6 +1071,282 @@ EAPClientInvokeUI(cstate)
     return 0;
 }
 
+/*
+ * EapAsyncWorker - Worker thread, runs the jobs submitted by the plugins.
+ */
+static void *
+EapAsyncWorker(arg)
+    void *arg;
+{
+    eap_job	*job, **jobp;
+    char	c = 0;
+
+    pthread_detach(pthread_self());
+
+    pthread_mutex_lock(&eap_job_lock);
+    for (;;) {
+        eap_job_idle++;
+        while (eap_job_queue == NULL)
+            pthread_cond_wait(&eap_job_queued, &eap_job_lock);
+        eap_job_idle--;
+
+        job = eap_job_queue;
+        eap_job_queue = job->next;
+        job->cstate->async_running++;
+        pthread_mutex_unlock(&eap_job_lock);
+
+        job->work(job->arg);
+
+        pthread_mutex_lock(&eap_job_lock);
+        job->cstate->async_running--;
+        job->next = NULL;
+        for (jobp = &eap_job_done; *jobp; jobp = &(*jobp)->next)
+            ;
+        *jobp = job;
+        pthread_cond_broadcast(&eap_job_finished);
+        /* non blocking, a full pipe already wakes up the main loop */
+        write(eap_job_fds[1], &c, 1);
+    }
+    return 0;
+}
+
+/*
+ * EapAsyncRelease - A job has been reported or cancelled.
+ */
+static void
+EapAsyncRelease(cstate)
+    eap_state *cstate;
+{
+    if (--eap_job_outstanding)
+        return;
+
+    remove_fd(eap_job_fds[0]);
+    if (wait_input_hook == EAPInput_fd && cstate->client_ext_ui_fds[0] == -1)
+        wait_input_hook = 0;
+}
+
+/*
+ * EapAsyncSubmit - Queue work for a plugin, called thru EAP_Input.
+ * Only one job at a time for each plugin context.
+ */
+static int
+EapAsyncSubmit(eap_in, work, arg)
+    EAP_Input *eap_in;
+    void (*work) __P((void *));
+    void *arg;
+{
+    eap_state	*cstate = NULL;
+    eap_job	*job, **jobp;
+    pthread_t	thread;
+    sigset_t	mask, oldmask;
+    int		i, server = 0;
+
+    for (i = 0; i < NUM_PPP && cstate == NULL; i++) {
+        if (eap[i].client_ext_input == eap_in)
+            cstate = &eap[i];
+        else if (eap[i].server_ext_input == eap_in) {
+            cstate = &eap[i];
+            server = 1;
+        }
+    }
+    if (cstate == NULL || work == NULL
+        || (server ? cstate->server_ext_pending : cstate->client_ext_pending))
+        return -1;
+
+    if (eap_job_fds[0] == -1) {
+        if (pipe(eap_job_fds) < 0) {
+            error("EAP failed to create pipe for asynchronous work...\n");
+            return -1;
+        }
+        fcntl(eap_job_fds[0], F_SETFL, fcntl(eap_job_fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(eap_job_fds[1], F_SETFL, fcntl(eap_job_fds[1], F_GETFL) | O_NONBLOCK);
+    }
+    if (!eap_job_atfork) {
+        pthread_atfork(EapAsyncForkPrepare, EapAsyncForkParent, EapAsyncForkChild);
+        eap_job_atfork = 1;
+    }
+
+    job = (eap_job *)malloc(sizeof(eap_job));
+    if (job == NULL)
+        return -1;
+    job->next = NULL;
+    job->cstate = cstate;
+    job->server = server;
+    job->work = work;
+    job->arg = arg;
+
+    pthread_mutex_lock(&eap_job_lock);
+    if (eap_job_idle == 0 && eap_job_workers < EAP_ASYNC_WORKERS) {
+        /* signals must keep being delivered to the main thread */
+        sigfillset(&mask);
+        pthread_sigmask(SIG_SETMASK, &mask, &oldmask);
+        if (pthread_create(&thread, NULL, EapAsyncWorker, NULL) == 0)
+            eap_job_workers++;
+        pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+    }
+    if (eap_job_workers == 0) {
+        pthread_mutex_unlock(&eap_job_lock);
+        free(job);
+        error("EAP failed to create thread for asynchronous work...\n");
+        return -1;
+    }
+    for (jobp = &eap_job_queue; *jobp; jobp = &(*jobp)->next)
+        ;
+    *jobp = job;
+    pthread_cond_signal(&eap_job_queued);
+    pthread_mutex_unlock(&eap_job_lock);
+
+    if (eap_job_outstanding++ == 0)
+        add_fd(eap_job_fds[0]);
+    wait_input_hook = EAPInput_fd;
+
+    if (server)
+        cstate->server_ext_pending = 1;
+    else
+        cstate->client_ext_pending = 1;
+    return 0;
+}
+
+/*
+ * EapAsyncDone - Report the jobs run to their plugins.
+ */
+static void
+EapAsyncDone()
+{
+    eap_job	*job;
+    eap_state	*cstate;
+    char	buf[32];
+
+    while (read(eap_job_fds[0], buf, sizeof(buf)) > 0)
+        ;
+
+    for (;;) {
+        /* one at a time, reporting a job can cancel the others */
+        pthread_mutex_lock(&eap_job_lock);
+        if ((job = eap_job_done))
+            eap_job_done = job->next;
+        pthread_mutex_unlock(&eap_job_lock);
+        if (job == NULL)
+            break;
+
+        cstate = job->cstate;
+        EapAsyncRelease(cstate);
+        if (job->server) {
+            cstate->server_ext_pending = 0;
+            EAPServerProcess(cstate, EAP_NOTIFICATION_ASYNC_DONE, job->arg, 0);
+        }
+        else {
+            cstate->client_ext_pending = 0;
+            EAPClientProcess(cstate, EAP_NOTIFICATION_ASYNC_DONE, job->arg, 0);
+        }
+        free(job);
+    }
+}
+
+/*
+ * EapAsyncCancel - Forget the jobs of a unit, before its plugins go away.
+ * Work already running can't be interrupted, wait for it.
+ */
+static void
+EapAsyncCancel(cstate)
+    eap_state *cstate;
+{
+    eap_job	**jobp, *job, *cancelled = NULL;
+
+    if (!cstate->client_ext_pending && !cstate->server_ext_pending)
+        return;
+
+    pthread_mutex_lock(&eap_job_lock);
+    for (jobp = &eap_job_queue; (job = *jobp); ) {
+        if (job->cstate == cstate) {
+            *jobp = job->next;
+            job->next = cancelled;
+            cancelled = job;
+        }
+        else
+            jobp = &job->next;
+    }
+    while (cstate->async_running)
+        pthread_cond_wait(&eap_job_finished, &eap_job_lock);
+    for (jobp = &eap_job_done; (job = *jobp); ) {
+        if (job->cstate == cstate) {
+            *jobp = job->next;
+            job->next = cancelled;
+            cancelled = job;
+        }
+        else
+            jobp = &job->next;
+    }
+    pthread_mutex_unlock(&eap_job_lock);
+
+    while ((job = cancelled)) {
+        cancelled = job->next;
+        EapAsyncRelease(cstate);
+        free(job);
+    }
+    cstate->client_ext_pending = 0;
+    cstate->server_ext_pending = 0;
+}
+
+/*
+ * EapAsyncFork* - Keep the job lock consistent across fork().
+ * Only the forking thread exists in the child, forget the workers.
+ * Work queued or running in the parent never completes in the child,
+ * so the child drops every job and clears the pending flags, letting
+ * the plugins submit again. The completion pipe is shared with the
+ * parent, the child closes its copy and makes a new one when needed.
+ * That only matters for detach(), which runs before authentication,
+ * or after it with updetach; other children exec right away.
+ */
+static void
+EapAsyncForkPrepare()
+{
+    pthread_mutex_lock(&eap_job_lock);
+}
+
+static void
+EapAsyncForkParent()
+{
+    pthread_mutex_unlock(&eap_job_lock);
+}
+
+static void
+EapAsyncForkChild()
+{
+    eap_job	*job;
+    int		i;
+
+    eap_job_workers = 0;
+    eap_job_idle = 0;
+    while ((job = eap_job_queue)) {
+        eap_job_queue = job->next;
+        free(job);
+    }
+    while ((job = eap_job_done)) {
+        eap_job_done = job->next;
+        free(job);
+    }
+    for (i = 0; i < NUM_PPP; i++) {
+        eap[i].async_running = 0;
+        eap[i].client_ext_pending = 0;
+        eap[i].server_ext_pending = 0;
+    }
+    pthread_mutex_unlock(&eap_job_lock);
+
+    if (eap_job_outstanding) {
+        eap_job_outstanding = 0;
+        remove_fd(eap_job_fds[0]);
+        if (wait_input_hook == EAPInput_fd && eap[0].client_ext_ui_fds[0] == -1)
+            wait_input_hook = 0;
+    }
+    if (eap_job_fds[0] != -1) {
+        close(eap_job_fds[0]);
+        close(eap_job_fds[1]);
+        eap_job_fds[0] = -1;
+        eap_job_fds[1] = -1;
+    }
+}
+
 /*
  * EAPClientAction - Perform the action in the client context.
  */
@@ -1028,6 +1359,7 @@ EAPClientAction(cstate)
 
     switch (eap_out->action) {
         case EAP_ACTION_NONE:
+        case EAP_ACTION_PENDING:
             break;
             
         case EAP_ACTION_SEND_WITH_TIMEOUT:
@@ -1092,6 +1424,11 @@ EAPServerProcess(eap_state *cstate, u_int16_t notification, u_char *inpacket, in
         /* ignore the call */
     	return 0;
 
+    if (cstate->server_ext_pending && notification != EAP_NOTIFICATION_ASYNC_DONE) {
+        EAPDEBUG(("EAPServerProcess: plugin busy, notification %d dropped.", notification));
+        return 0;
+    }
+
     /* setup in and out structures */
     cstate->server_ext_input->notification = notification;
     cstate->server_ext_input->data = inpacket;
@@ -1168,6 +1505,7 @@ EAPServerAction(cstate)
     
     switch (eap_out->action) {
         case EAP_ACTION_NONE:
+        case EAP_ACTION_PENDING:
             break;
             
         case EAP_ACTION_SEND_WITH_TIMEOUT:
@@ -110,6 +110,10 @@ typedef struct eap_state {
     EAP_Input *server_ext_input;	/* server eap extension input structure */
     EAP_Output *server_ext_output;	/* server eap extension output structure */
 
+    int client_ext_pending;	/* client extension waits for async work */
+    int server_ext_pending;	/* server extension waits for async work */
+    int async_running;		/* async work being run by the workers */
+
 } eap_state;
 
 
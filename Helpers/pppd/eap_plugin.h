@@ -116,6 +116,7 @@ struct EAP_Packet
 #define EAP_NOTIFICATION_PACKET		4
 #define EAP_NOTIFICATION_DATA_FROM_UI	5
 #define EAP_NOTIFICATION_TIMEOUT	6
+#define EAP_NOTIFICATION_ASYNC_DONE	7	// work submitted with async_submit is done, data is its arg
 
 typedef struct EAP_Input {
     u_int16_t 	size; 		// size of the structure (for future extension)
@@ -130,8 +131,20 @@ typedef struct EAP_Input {
     char 	*password;	// authenticatee password
     void 	(*log_debug) __P((char *, ...));	/* log a debug message */
     void 	(*log_error) __P((char *, ...));	/* log an error message */
+    /* 
+     * run work(arg) on a worker thread, outside of the engine main loop.
+     * the module then returns EAP_ACTION_PENDING, and process is called 
+     * again with EAP_NOTIFICATION_ASYNC_DONE once work has returned.
+     * until then, the engine doesn't call process for this context and
+     * drops the packets received. work must not call the log functions.
+     * returns 0 if the work was queued.
+     * only present if size covers it, see EAP_INPUT_HAS_ASYNC.
+     */
+    int 	(*async_submit) __P((struct EAP_Input *eap_in, void (*work)(void *arg), void *arg));
 } EAP_Input;
 
+#define EAP_INPUT_HAS_ASYNC(in)	((in)->size >= sizeof(EAP_Input) && (in)->async_submit)
+
 #define EAP_ACTION_NONE			0
 #define EAP_ACTION_SEND			1
 #define EAP_ACTION_INVOKE_UI		2
@@ -140,6 +153,7 @@ typedef struct EAP_Input {
 #define EAP_ACTION_SEND_WITH_TIMEOUT	5
 #define EAP_ACTION_SEND_AND_DONE	6
 #define EAP_ACTION_CANCEL		7
+#define EAP_ACTION_PENDING		8	// waiting for work submitted with async_submit
 
 
 typedef struct EAP_Output {
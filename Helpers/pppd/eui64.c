@@ -72,7 +72,7 @@ char *
 eui64_ntoa(e)
     eui64_t e;
 {
-    static char buf[32];
+    static __thread char buf[32];	/* also used by the log thread */
 
     snprintf(buf, 32, "%02x%02x:%02x%02x:%02x%02x:%02x%02x",
 	     e.e8[0], e.e8[1], e.e8[2], e.e8[3], 
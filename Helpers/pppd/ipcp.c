@@ -159,6 +159,17 @@ static void ipcp_up __P((fsm *));		/* We're UP */
 static void ipcp_down __P((fsm *));		/* We're DOWN */
 static void ipcp_finished __P((fsm *));	/* Don't need lower layer */
 static void ipcp_retransmit __P((fsm *));	/* Our confreq is timed out */
+static int  ipcp_cache_apply __P((fsm *));
+
+/*
+ * Record kept with optcache, see struct lcp_cache.
+ */
+struct ipcp_cache {
+    ipcp_options want;
+    ipcp_options got;
+};
+static struct ipcp_cache ipcp_cache[NUM_PPP];
+static bool ipcp_cached[NUM_PPP];	/* our CI started from the cache */
 
 fsm ipcp_fsm[NUM_PPP];		/* IPCP fsm structure */
 
@@ -788,6 +799,7 @@ ipcp_resetci(f)
     *go = *wo;
     if (!ask_for_local)
 	go->ouraddr = 0;
+    ipcp_cached[f->unit] = ipcp_cache_apply(f);
     if (ip_choose_hook) {
 	ip_choose_hook(&wo->hisaddr);
 	if (wo->hisaddr) {
@@ -797,6 +809,55 @@ ipcp_resetci(f)
 }
 
 
+/*
+ * ipcp_cache_apply - start our CI from what the peer agreed to last time:
+ * typically the address and DNS servers it assigned, which we would
+ * otherwise ask for with 0.0.0.0 and get in a Nak, and the options it
+ * rejected.  The peer is free to Nak the cached values again.
+ */
+static int
+ipcp_cache_apply(f)
+    fsm *f;
+{
+    ipcp_options *wo = &ipcp_wantoptions[f->unit];
+    ipcp_options *go = &ipcp_gotoptions[f->unit];
+    struct ipcp_cache *c = &ipcp_cache[f->unit];
+    struct ipcp_cache saved;
+    int i;
+
+    if (!optcache)
+	return 0;
+    c->want = *wo;
+    if (!optcache_load("ipcp", &saved, sizeof(saved))
+	|| memcmp(&saved.want, &c->want, sizeof(c->want)) != 0)
+	return 0;
+
+    go->neg_addr = go->neg_addr && saved.got.neg_addr;
+    go->old_addrs = go->old_addrs && saved.got.old_addrs;
+    if ((go->neg_addr || go->old_addrs) && wo->accept_local
+	&& go->ouraddr == 0)
+	go->ouraddr = saved.got.ouraddr;
+    for (i = 0; i < 2; ++i) {
+	if ((i == 0? go->req_dns1: go->req_dns2))
+	    go->dnsaddr[i] = saved.got.dnsaddr[i];
+	if ((i == 0? go->req_wins1: go->req_wins2))
+	    go->winsaddr[i] = saved.got.winsaddr[i];
+    }
+    go->req_dns1 = go->req_dns1 && saved.got.req_dns1;
+    go->req_dns2 = go->req_dns2 && saved.got.req_dns2;
+    go->req_wins1 = go->req_wins1 && saved.got.req_wins1;
+    go->req_wins2 = go->req_wins2 && saved.got.req_wins2;
+    if ((go->neg_vj = go->neg_vj && saved.got.neg_vj)) {
+	go->old_vj = saved.got.old_vj;
+	go->vj_protocol = saved.got.vj_protocol;
+	go->maxslotindex = saved.got.maxslotindex;
+	go->cflag = saved.got.cflag;
+    }
+    dbglog("IPCP: starting from the options cached for %s", remoteaddress);
+    return 1;
+}
+
+
 /*
  * ipcp_cilen - Return length of our CI.
  * Called by fsm_sconfreq, Send Configure Request.
@@ -1811,6 +1872,11 @@ ipcp_up(f)
 	ipcp_close(f->unit, "Could not determine local IP address");
 	return;
     }
+    if (optcache) {
+	ipcp_cache[f->unit].got = *go;
+	optcache_save("ipcp", &ipcp_cache[f->unit], sizeof(ipcp_cache[f->unit]));
+	ipcp_cached[f->unit] = 0;
+    }
     if (ho->hisaddr == 0) {
 	ho->hisaddr = htonl(0x0a404040 + ifunit);
 	warning("Could not determine remote IP address: defaulting to %I",
@@ -2070,6 +2136,11 @@ static void
 ipcp_finished(f)
     fsm *f;
 {
+	/* the cached options never got us up, don't try them again */
+	if (ipcp_cached[f->unit]) {
+		optcache_forget("ipcp");
+		ipcp_cached[f->unit] = 0;
+	}
 	if (ipcp_is_open) {
 		ipcp_is_open = 0;
 		np_finished(f->unit, PPP_IP);
@@ -452,7 +452,7 @@ char *
 llv6_ntoa(ifaceid)
     eui64_t ifaceid;
 {
-    static char b[64];
+    static __thread char b[64];	/* also used by the log thread */
 
     snprintf(b, sizeof(b), "fe80::%s", eui64_ntoa(ifaceid));
     return b;
@@ -275,7 +275,7 @@ static char *
 ipx_ntoa(ipxaddr)
 u_int32_t ipxaddr;
 {
-    static char b[64];
+    static __thread char b[64];	/* also used by the log thread */
     slprintf(b, sizeof(b), "%x", ipxaddr);
     return b;
 }
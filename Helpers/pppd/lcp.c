@@ -99,6 +99,7 @@ int	lcp_echo_interval = 0; 	/* Interval between LCP echo-requests */
 int	lcp_echo_fails = 0;	/* Tolerance to unanswered echo-requests */
 bool	lax_recv = 0;		/* accept control chars in asyncmap */
 bool	noendpoint = 0;		/* don't send/accept endpoint discriminator */
+bool	lcp_echo_rtt = 0;	/* retry echo-requests after an RTT timeout */
 
 int lcp_echo_interval_slow = 0;
 int lcp_echo_fails_slow = 0;
@@ -179,6 +180,9 @@ static option_t lcp_option_list[] = {
       OPT_PRIO },
     { "lcp-echo-interval", o_int, &lcp_echo_interval,
       "Set time in seconds between LCP echo requests", OPT_PRIO },
+    { "lcp-echo-rtt", o_bool, &lcp_echo_rtt,
+      "Retry unanswered LCP echo requests after the measured round-trip time",
+      1 },
     { "lcp-restart", o_int, &lcp_fsm[0].timeouttime,
       "Set time in seconds between LCP retransmissions", OPT_PRIO },
     { "lcp-max-terminate", o_int, &lcp_fsm[0].maxtermtransmits,
@@ -225,8 +229,38 @@ static int lcp_echos_pending = 0;	/* Number of outstanding echo msgs */
 static int lcp_echo_number   = 0;	/* ID number of next echo frame */
 static int lcp_echo_timer_running = 0;  /* set if a timer is running */
 
+/*
+ * Round-trip times measured with the timestamp we put in our
+ * echo-requests, in microseconds.  Bucket i of the histogram counts
+ * the samples under 2^i ms, the last bucket all the slower ones.
+ */
+#define LCP_RTT_BUCKETS		12
+#define LCP_RTT_MAX		60000000	/* ignore anything slower */
+#define LCP_RTT_MIN_SAMPLES	3	/* before lcp-echo-rtt kicks in */
+#define LCP_RTT_PUBLISH		16	/* publish every so many samples */
+
+static struct lcp_rtt {
+    u_int32_t	samples;
+    u_int32_t	min, max;
+    u_int64_t	sum;
+    u_int32_t	srtt, rttvar;	/* smoothed as TCP does (RFC 2988) */
+    u_int32_t	hist[LCP_RTT_BUCKETS];
+} lcp_rtt;
+
 static u_char nak_buffer[PPP_MRU];	/* where we construct a nak packet */
 
+/*
+ * Record kept with optcache: the options we ended up with last time,
+ * and the wantoptions they were negotiated from, so that a change in
+ * the configuration doesn't pick up a stale set.
+ */
+struct lcp_cache {
+    lcp_options want;
+    lcp_options got;
+};
+static struct lcp_cache lcp_cache[NUM_PPP];
+static bool lcp_cached[NUM_PPP];	/* our CI started from the cache */
+
 #ifdef __APPLE__
 struct notifier *lcp_up_notify = NULL;
 struct notifier *lcp_down_notify = NULL;
@@ -251,6 +285,7 @@ static void lcp_starting __P((fsm *));	/* We need lower layer up */
 static void lcp_finished __P((fsm *));	/* We need lower layer down */
 static int  lcp_extcode __P((fsm *, int, int, u_char *, int));
 static void lcp_rprotrej __P((fsm *, u_char *, int));
+static int  lcp_cache_apply __P((fsm *));
 
 /*
  * routines to send LCP echos to peer
@@ -263,6 +298,9 @@ static void lcp_received_echo_reply __P((fsm *, int, u_char *, int));
 static void LcpSendEchoRequest __P((fsm *));
 static void LcpLinkFailure __P((fsm *));
 static void LcpEchoCheck __P((fsm *));
+static void lcp_rtt_sample __P((u_int32_t));
+static void lcp_rtt_publish __P((void));
+static u_int32_t lcp_rtt_rto __P((void));
 #ifdef __APPLE__
 static void lcp_received_timeremaining __P((fsm *, int, u_char *, int));
 #endif
@@ -719,11 +757,56 @@ lcp_resetci(f)
     }
     if (noendpoint)
 	ao->neg_endpoint = 0;
+    lcp_cached[f->unit] = lcp_cache_apply(f);
     peer_mru[f->unit] = PPP_MRU;
     auth_reset(f->unit);
 }
 
 
+/*
+ * lcp_cache_apply - start our CI from what the peer agreed to last time.
+ * Only options the peer may Nak or Reject are taken from the cache,
+ * and only if we still want them: the authentication we ask for and
+ * the magic number always come from wantoptions.
+ * If the peer changed its mind, the usual Nak/Reject processing applies.
+ */
+static int
+lcp_cache_apply(f)
+    fsm *f;
+{
+    lcp_options *wo = &lcp_wantoptions[f->unit];
+    lcp_options *go = &lcp_gotoptions[f->unit];
+    struct lcp_cache *c = &lcp_cache[f->unit];
+    struct lcp_cache saved;
+
+    if (!optcache)
+	return 0;
+    c->want = *wo;
+    c->want.magicnumber = 0;
+    c->want.numloops = 0;
+    if (!optcache_load("lcp", &saved, sizeof(saved))
+	|| memcmp(&saved.want, &c->want, sizeof(c->want)) != 0)
+	return 0;
+
+    if ((go->neg_mru = go->neg_mru && saved.got.neg_mru))
+	go->mru = saved.got.mru;
+    if ((go->neg_asyncmap = go->neg_asyncmap && saved.got.neg_asyncmap))
+	go->asyncmap = saved.got.asyncmap;
+    if ((go->neg_lqr = go->neg_lqr && saved.got.neg_lqr))
+	go->lqr_period = saved.got.lqr_period;
+    if ((go->neg_mrru = go->neg_mrru && saved.got.neg_mrru))
+	go->mrru = saved.got.mrru;
+    go->neg_magicnumber = go->neg_magicnumber && saved.got.neg_magicnumber;
+    go->neg_pcompression = go->neg_pcompression && saved.got.neg_pcompression;
+    go->neg_accompression = go->neg_accompression
+	&& saved.got.neg_accompression;
+    go->neg_ssnhf = go->neg_ssnhf && saved.got.neg_ssnhf;
+    go->neg_endpoint = go->neg_endpoint && saved.got.neg_endpoint;
+    dbglog("LCP: starting from the options cached for %s", remoteaddress);
+    return 1;
+}
+
+
 /*
  * lcp_cilen - Return length of our CI.
  */
@@ -1991,6 +2074,12 @@ lcp_up(f)
     if (ho->neg_mru)
 	peer_mru[f->unit] = ho->mru;
 
+    if (optcache) {
+	lcp_cache[f->unit].got = *go;
+	optcache_save("lcp", &lcp_cache[f->unit], sizeof(lcp_cache[f->unit]));
+	lcp_cached[f->unit] = 0;
+    }
+
 #ifdef __APPLE__
     notify(lcp_up_notify, 0);
 #endif
@@ -2046,6 +2135,11 @@ static void
 lcp_finished(f)
     fsm *f;
 {
+    /* the cached options never got us up, don't try them again */
+    if (lcp_cached[f->unit]) {
+	optcache_forget("lcp");
+	lcp_cached[f->unit] = 0;
+    }
     link_terminated(f->unit);
 }
 
@@ -2309,13 +2403,91 @@ LcpEchoCheck (f)
 
     /*
      * Start the timer for the next interval.
+     * Once an echo-request went unanswered for a whole interval, and
+     * we know how long the peer usually takes to answer, don't wait
+     * another interval before each retry.
      */
     if (lcp_echo_timer_running)
 	warning("assertion lcp_echo_timer_running==0 failed");
-    TIMEOUT (LcpEchoTimeout, f, lcp_echo_interval);
+    if (lcp_echo_rtt && lcp_echos_pending > 1
+	&& lcp_rtt.samples >= LCP_RTT_MIN_SAMPLES) {
+	u_int32_t rto = lcp_rtt_rto();
+
+	timeout(LcpEchoTimeout, f, rto / 1000000, rto % 1000000);
+    } else
+	TIMEOUT (LcpEchoTimeout, f, lcp_echo_interval);
     lcp_echo_timer_running = 1;
 }
 
+/*
+ * lcp_rtt_rto - how long to wait for an echo-reply before retrying,
+ * as TCP computes its retransmission timeout (RFC 2988), in microseconds,
+ * no less than a second and no more than lcp_echo_interval.
+ */
+static u_int32_t
+lcp_rtt_rto()
+{
+    u_int32_t rto;
+    u_int64_t max;
+
+    rto = lcp_rtt.srtt + MAX(4 * lcp_rtt.rttvar, 10000);
+    max = lcp_echo_interval > 1? (u_int64_t)lcp_echo_interval * 1000000: 1000000;
+    if (rto > max)
+	rto = (u_int32_t)max;
+    if (rto < 1000000)
+	rto = 1000000;
+    return rto;
+}
+
+/*
+ * lcp_rtt_sample - account for the round-trip time of an echo.
+ */
+static void
+lcp_rtt_sample(rtt)
+    u_int32_t rtt;
+{
+    u_int32_t delta, ms;
+    int b;
+
+    if (lcp_rtt.samples == 0) {
+	lcp_rtt.min = lcp_rtt.max = rtt;
+	lcp_rtt.srtt = rtt;
+	lcp_rtt.rttvar = rtt / 2;
+    } else {
+	if (rtt < lcp_rtt.min)
+	    lcp_rtt.min = rtt;
+	if (rtt > lcp_rtt.max)
+	    lcp_rtt.max = rtt;
+	delta = rtt > lcp_rtt.srtt? rtt - lcp_rtt.srtt: lcp_rtt.srtt - rtt;
+	lcp_rtt.rttvar = (3 * lcp_rtt.rttvar + delta) / 4;
+	lcp_rtt.srtt = (7 * lcp_rtt.srtt + rtt) / 8;
+    }
+    lcp_rtt.sum += rtt;
+    ++lcp_rtt.samples;
+
+    ms = rtt / 1000;
+    for (b = 0; b < LCP_RTT_BUCKETS - 1 && ms >= (1U << b); ++b)
+	;
+    ++lcp_rtt.hist[b];
+
+    if (lcp_rtt.samples == 1 || lcp_rtt.samples % LCP_RTT_PUBLISH == 0)
+	lcp_rtt_publish();
+}
+
+/*
+ * lcp_rtt_publish - let the controller know about the round-trip times.
+ */
+static void
+lcp_rtt_publish()
+{
+    if (lcp_rtt.samples == 0)
+	return;
+#ifdef __APPLE__
+    sys_publish_lcp_rtt(lcp_rtt.min, (u_int32_t)(lcp_rtt.sum / lcp_rtt.samples),
+			lcp_rtt.max, lcp_rtt.srtt, lcp_rtt.hist, LCP_RTT_BUCKETS);
+#endif
+}
+
 /*
  * LcpEchoTimeout - Timer expired on the LCP echo
  */
@@ -2341,7 +2513,9 @@ lcp_received_echo_reply (f, id, inp, len)
     u_char *inp;
     int len;
 {
-    u_int32_t magic;
+    u_int32_t magic, sec, usec;
+    struct timeval now;
+    int64_t rtt;
 
     /* Check the magic number - don't count replies from ourselves. */
     if (len < 4) {
@@ -2355,6 +2529,18 @@ lcp_received_echo_reply (f, id, inp, len)
 	return;
     }
 
+    /*
+     * Peers normally send our data back, including the time we sent
+     * the request at: if it looks sane, that's a round-trip sample.
+     */
+    if (len >= 12 && getabsolutetime(&now) == 0) {
+	GETLONG(sec, inp);
+	GETLONG(usec, inp);
+	rtt = ((int64_t)now.tv_sec - sec) * 1000000 + now.tv_usec - usec;
+	if (usec < 1000000 && rtt >= 0 && rtt < LCP_RTT_MAX)
+	    lcp_rtt_sample((u_int32_t)rtt);
+    }
+
     /* Reset the number of outstanding echo frames */
     lcp_echos_pending = 0;
 
@@ -2373,8 +2559,10 @@ LcpSendEchoRequest (f)
     fsm *f;
 {
     u_int32_t lcp_magic;
-    u_char pkt[4], *pktp;
+    u_char pkt[12], *pktp;
     struct ppp_idle idle;
+    struct timeval now;
+    time_t idle_limit;
 
     /* 
         Don't sent echo request if activity is detected on the link
@@ -2384,8 +2572,13 @@ LcpSendEchoRequest (f)
 #if __APPLE__
     if (ppp_variable_echo_is_off()) {
 #endif /* __APPLE__ */
+    /* when retrying early, only what came in since the last echo counts */
+    idle_limit = lcp_echo_interval;
+    if (lcp_echo_rtt && lcp_echos_pending > 1
+	&& lcp_rtt.samples >= LCP_RTT_MIN_SAMPLES)
+	idle_limit = (lcp_rtt_rto() + 999999) / 1000000;
     if (get_idle_time(0, &idle)) {
-        if (idle.recv_idle < lcp_echo_interval) {
+        if (idle.recv_idle < idle_limit) {
             lcp_echos_pending = 0;
 #if __APPLE__
             ppp_auxiliary_probe_stop();
@@ -2419,6 +2612,10 @@ LcpSendEchoRequest (f)
         lcp_magic = lcp_gotoptions[f->unit].magicnumber;
 	pktp = pkt;
 	PUTLONG(lcp_magic, pktp);
+	if (getabsolutetime(&now) == 0) {
+	    PUTLONG((u_int32_t)now.tv_sec, pktp);
+	    PUTLONG((u_int32_t)now.tv_usec, pktp);
+	}
         fsm_sdata(f, ECHOREQ, lcp_echo_number++ & 0xFF, pkt, (int)(pktp - pkt));
 	++lcp_echos_pending;
     }
@@ -2438,6 +2635,7 @@ lcp_echo_lowerup (unit)
     lcp_echos_pending      = 0;
     lcp_echo_number        = 0;
     lcp_echo_timer_running = 0;
+    memset(&lcp_rtt, 0, sizeof(lcp_rtt));
 #if __APPLE__
     ppp_auxiliary_probe_init();
 #endif
@@ -2462,6 +2660,12 @@ lcp_echo_lowerdown (unit)
         lcp_echo_timer_running = 0;
     }
 
+    if (lcp_rtt.samples != 0) {
+	info("LCP echo round-trip min/avg/max %u/%u/%u ms over %u samples",
+	     lcp_rtt.min / 1000, (u_int32_t)(lcp_rtt.sum / lcp_rtt.samples / 1000),
+	     lcp_rtt.max / 1000, lcp_rtt.samples);
+	lcp_rtt_publish();
+    }
 }
 
 #ifdef __APPLE__
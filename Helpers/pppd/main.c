@@ -550,6 +550,11 @@ main(argc, argv)
 
     setup_signals();
 
+    if (async_log)
+	log_async_start();
+    if (pcap_file)
+	pcap_start();
+
     waiting = 0;
 
     /*
@@ -1228,6 +1233,8 @@ detach()
 	return;
     if (pipe(pipefd) == -1)
 	pipefd[0] = pipefd[1] = -1;
+    /* the log thread is not inherited, write out its records first */
+    log_async_stop();
     if ((pid = fork()) < 0) {
 	error("Couldn't detach (fork failed: %m)");
 	die(1);			/* or just return? */
@@ -1250,6 +1257,8 @@ detach()
     detached = 1;
     if (log_default)
 	log_to_fd = -1;
+    if (async_log)
+	log_async_start();
     slprintf(numbuf, sizeof(numbuf), "%d", getpid());
     script_setenv("PPPD_PID", numbuf, 1);
 
@@ -1604,6 +1613,7 @@ die(status)
 #endif
     cleanup();
     notify(exitnotify, status);
+    log_async_stop();
     sys_log(LOG_INFO, "Exit.");
     exit(status);
 }
@@ -1675,16 +1685,134 @@ update_link_stats(u)
 }
 
 
+/*
+ * Pending callouts are kept in a binary min-heap ordered by expiry time,
+ * then by order of scheduling so that equal times still fire first in first out,
+ * and hashed by (func, arg) so that untimeout() does not need to scan them.
+ * Entries are recycled through a free list instead of going back to malloc.
+ */
 struct	callout {
     struct timeval	c_time;		/* time at which to call routine */
     void		*c_arg;		/* argument to routine */
     void		(*c_func) __P((void *)); /* routine */
-    struct		callout *c_next;
+    struct		callout *c_next;	/* hash chain, or free list link */
+    int			c_index;	/* position in the heap */
+    u_int32_t		c_seq;		/* scheduling order, breaks ties on c_time */
 };
 
-static struct callout *callout = NULL;	/* Callout list */
+#define CALLOUT_HASH_SIZE	64
+
+static struct callout **callout_heap = NULL;	/* Callout heap, earliest first */
+static int callout_count = 0;			/* number of pending callouts */
+static int callout_max = 0;			/* allocated size of the heap */
+static struct callout *callout_hash[CALLOUT_HASH_SIZE]; /* pending callouts by (func, arg) */
+static struct callout *callout_free = NULL;	/* recycled callouts */
+static u_int32_t callout_seq = 0;		/* next scheduling order */
 static struct timeval timenow;		/* Current time */
 
+#define CALLOUT_BEFORE(a, b) \
+    ((a)->c_time.tv_sec < (b)->c_time.tv_sec \
+     || ((a)->c_time.tv_sec == (b)->c_time.tv_sec \
+	 && ((a)->c_time.tv_usec < (b)->c_time.tv_usec \
+	     || ((a)->c_time.tv_usec == (b)->c_time.tv_usec \
+		 && (int32_t)((a)->c_seq - (b)->c_seq) < 0))))
+
+/*
+ * callout_hashkey - bucket for a (func, arg) pair.
+ */
+static int
+callout_hashkey(func, arg)
+    void (*func) __P((void *));
+    void *arg;
+{
+    uintptr_t h = (uintptr_t) func ^ ((uintptr_t) arg >> 3) ^ ((uintptr_t) arg >> 11);
+
+    return (int) ((h ^ (h >> 7)) % CALLOUT_HASH_SIZE);
+}
+
+/*
+ * callout_set - store a callout in a heap slot.
+ */
+static void
+callout_set(i, p)
+    int i;
+    struct callout *p;
+{
+    callout_heap[i] = p;
+    p->c_index = i;
+}
+
+/*
+ * callout_up - move a callout up the heap until its parent is earlier.
+ */
+static void
+callout_up(i)
+    int i;
+{
+    struct callout *p = callout_heap[i];
+    int parent;
+
+    while (i > 0) {
+	parent = (i - 1) / 2;
+	if (!CALLOUT_BEFORE(p, callout_heap[parent]))
+	    break;
+	callout_set(i, callout_heap[parent]);
+	i = parent;
+    }
+    callout_set(i, p);
+}
+
+/*
+ * callout_down - move a callout down the heap until its children are later.
+ */
+static void
+callout_down(i)
+    int i;
+{
+    struct callout *p = callout_heap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < callout_count) {
+	if (child + 1 < callout_count
+	    && CALLOUT_BEFORE(callout_heap[child + 1], callout_heap[child]))
+	    child++;
+	if (!CALLOUT_BEFORE(callout_heap[child], p))
+	    break;
+	callout_set(i, callout_heap[child]);
+	i = child;
+    }
+    callout_set(i, p);
+}
+
+/*
+ * callout_remove - take a pending callout out of the heap and the hash,
+ * and put it back on the free list.
+ */
+static void
+callout_remove(p)
+    struct callout *p;
+{
+    struct callout **pp;
+    int i = p->c_index;
+
+    for (pp = &callout_hash[callout_hashkey(p->c_func, p->c_arg)]; *pp; pp = &(*pp)->c_next)
+	if (*pp == p) {
+	    *pp = p->c_next;
+	    break;
+	}
+
+    if (--callout_count != i) {
+	callout_set(i, callout_heap[callout_count]);
+	if (i > 0 && CALLOUT_BEFORE(callout_heap[i], callout_heap[(i - 1) / 2]))
+	    callout_up(i);
+	else
+	    callout_down(i);
+    }
+
+    p->c_next = callout_free;
+    callout_free = p;
+}
+
 /*
  * timeout - Schedule a timeout.
  */
@@ -1694,18 +1822,29 @@ timeout(func, arg, secs, usecs)
     void *arg;
     int secs, usecs;
 {
-    struct callout *newp, *p, **pp;
+    struct callout *newp, **bucket;
 
     MAINDEBUG(("Timeout %p:%p in %d.%03d seconds.", func, arg,
 	       secs, usecs/1000));
 
     /*
-     * Allocate timeout.
+     * Allocate timeout, and make room in the heap.
      */
-    if ((newp = (struct callout *) malloc(sizeof(struct callout))) == NULL)
+    if (callout_count == callout_max) {
+	int max = callout_max ? callout_max * 2 : 16;
+	struct callout **heap = realloc(callout_heap, max * sizeof(struct callout *));
+	if (heap == NULL)
+	    fatal("Out of memory in timeout()!");
+	callout_heap = heap;
+	callout_max = max;
+    }
+    if ((newp = callout_free) != NULL)
+	callout_free = newp->c_next;
+    else if ((newp = (struct callout *) malloc(sizeof(struct callout))) == NULL)
 	fatal("Out of memory in timeout()!");
     newp->c_arg = arg;
     newp->c_func = func;
+    newp->c_seq = callout_seq++;
 #ifdef __APPLE__
     // timeout get screwed up if you change the current time of the machine...
     // use absolute time instead, as we are just interested in deltas, not actual time.
@@ -1721,15 +1860,13 @@ timeout(func, arg, secs, usecs)
     }
 
     /*
-     * Find correct place and link it in.
+     * Link it in the hash, and in the heap.
      */
-    for (pp = &callout; (p = *pp); pp = &p->c_next)
-	if (newp->c_time.tv_sec < p->c_time.tv_sec
-	    || (newp->c_time.tv_sec == p->c_time.tv_sec
-		&& newp->c_time.tv_usec < p->c_time.tv_usec))
-	    break;
-    newp->c_next = p;
-    *pp = newp;
+    bucket = &callout_hash[callout_hashkey(func, arg)];
+    newp->c_next = *bucket;
+    *bucket = newp;
+    callout_set(callout_count++, newp);
+    callout_up(newp->c_index);
 }
 
 
@@ -1741,19 +1878,20 @@ untimeout(func, arg)
     void (*func) __P((void *));
     void *arg;
 {
-    struct callout **copp, *freep;
+    struct callout *p, *first = NULL;
 
     MAINDEBUG(("Untimeout %p:%p.", func, arg));
 
     /*
-     * Find first matching timeout and remove it from the list.
+     * Find the first matching timeout to expire and remove it.
      */
-    for (copp = &callout; (freep = *copp); copp = &freep->c_next)
-	if (freep->c_func == func && freep->c_arg == arg) {
-	    *copp = freep->c_next;
-	    free((char *) freep);
-	    break;
-	}
+    for (p = callout_hash[callout_hashkey(func, arg)]; p; p = p->c_next)
+	if (p->c_func == func && p->c_arg == arg
+	    && (first == NULL || CALLOUT_BEFORE(p, first)))
+	    first = p;
+
+    if (first)
+	callout_remove(first);
 }
 
 
@@ -1764,25 +1902,35 @@ static void
 calltimeout()
 {
     struct callout *p;
+    struct timeval now;
+    void (*func) __P((void *));
+    void *arg;
 
-    while (callout != NULL) {
-	p = callout;
-
+    /*
+     * Read the clock once per round. Callouts that become due while the
+     * handlers run are left for the next round of the main loop, after
+     * wait_input returns at once on a zero timeleft.
+     */
 #ifdef __APPLE__
-        if (getabsolutetime(&timenow) < 0)
+    if (getabsolutetime(&timenow) < 0)
 #else
-	if (gettimeofday(&timenow, NULL) < 0)
+    if (gettimeofday(&timenow, NULL) < 0)
 #endif
-	    fatal("Failed to get time of day: %m");
-	if (!(p->c_time.tv_sec < timenow.tv_sec
-	      || (p->c_time.tv_sec == timenow.tv_sec
-		  && p->c_time.tv_usec <= timenow.tv_usec)))
-	    break;		/* no, it's not time yet */
+	fatal("Failed to get time of day: %m");
+    now = timenow;	/* handlers may update timenow */
 
-	callout = p->c_next;
-	(*p->c_func)(p->c_arg);
+    while (callout_count) {
+	p = callout_heap[0];
+
+	if (!(p->c_time.tv_sec < now.tv_sec
+	      || (p->c_time.tv_sec == now.tv_sec
+		  && p->c_time.tv_usec <= now.tv_usec)))
+	    break;		/* no, it's not time yet */
 
-	free((char *) p);
+	func = p->c_func;
+	arg = p->c_arg;
+	callout_remove(p);
+	(*func)(arg);
     }
 }
 
@@ -1794,7 +1942,7 @@ static struct timeval *
 timeleft(tvp)
     struct timeval *tvp;
 {
-    if (callout == NULL)
+    if (callout_count == 0)
 	return NULL;
 
 #ifdef __APPLE__
@@ -1802,8 +1950,8 @@ timeleft(tvp)
 #else
     gettimeofday(&timenow, NULL);
 #endif
-    tvp->tv_sec = callout->c_time.tv_sec - timenow.tv_sec;
-    tvp->tv_usec = callout->c_time.tv_usec - timenow.tv_usec;
+    tvp->tv_sec = callout_heap[0]->c_time.tv_sec - timenow.tv_sec;
+    tvp->tv_usec = callout_heap[0]->c_time.tv_usec - timenow.tv_usec;
     if (tvp->tv_usec < 0) {
 	tvp->tv_usec += 1000000;
 	tvp->tv_sec -= 1;
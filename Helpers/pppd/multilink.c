@@ -76,6 +76,7 @@ extern char db_key[];
 static int get_default_epdisc __P((struct epdisc *));
 static int parse_num __P((char *str, const char *key, int *valp));
 static int owns_unit __P((TDB_DATA pid, int unit));
+static int same_key __P((TDB_DATA kd, TDB_DATA vd, void *state));
 
 #define set_ip_epdisc(ep, addr) do {	\
 	ep->length = 4;			\
@@ -253,6 +254,20 @@ parse_num(str, key, valp)
 	return 0;
 }
 
+/*
+ * Compare the pppd key stored for a unit with `state', in place.
+ */
+static int
+same_key(kd, vd, state)
+     TDB_DATA kd, vd;
+     void *state;
+{
+	TDB_DATA *key = state;
+
+	return vd.dsize == key->dsize
+		&& memcmp(vd.dptr, key->dptr, vd.dsize) == 0;
+}
+
 /*
  * Check whether the pppd identified by `key' still owns ppp unit `unit'.
  */
@@ -262,19 +277,12 @@ owns_unit(key, unit)
      int unit;
 {
 	char ifkey[32];
-	TDB_DATA kd, vd;
-	int ret = 0;
+	TDB_DATA kd;
 
 	slprintf(ifkey, sizeof(ifkey), "IFNAME=ppp%d", unit);
 	kd.dptr = ifkey;
 	kd.dsize = strlen(ifkey);
-	vd = tdb_fetch(pppdb, kd);
-	if (vd.dptr != NULL) {
-		ret = vd.dsize == key.dsize
-			&& memcmp(vd.dptr, key.dptr, vd.dsize) == 0;
-		free(vd.dptr);
-	}
-	return ret;
+	return tdb_parse_record(pppdb, kd, same_key, &key) == 1;
 }
 
 static int
@@ -322,7 +330,7 @@ char *
 epdisc_to_str(ep)
      struct epdisc *ep;
 {
-	static char str[MAX_ENDP_LEN*3+8];
+	static __thread char str[MAX_ENDP_LEN*3+8];	/* also used by the log thread */
 	u_char *p = ep->value;
 	int i, mask = 0;
 	char *q, c, c2;
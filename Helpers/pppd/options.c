@@ -134,6 +134,9 @@ char	passwd[MAXSECRETLEN] = { 0 };	/* Password for PAP */
 bool	persist = 0;		/* Reopen link after it goes down */
 char	our_name[MAXNAMELEN] = { 0 };	/* Our name for authentication purposes */
 bool	demand = 0;		/* do dial-on-demand */
+int	demand_hold_packets = 64; /* packets held while the link comes up */
+int	demand_hold_bytes = 65536; /* bytes held while the link comes up */
+int	demand_hold_flow = 16;	/* packets held per flow */
 char	*ipparam = NULL;	/* Extra parameter for ip up/down scripts */
 int	idle_time_limit = 0;	/* Disconnect if idle for this many seconds */
 bool   	noidlerecv = 0;         /* Disconnect if idle only for outgoing traffic */
@@ -142,6 +145,12 @@ int	holdoff = 30;		/* # seconds to pause before reconnecting */
 bool	holdoff_specified = FALSE;	/* true if a holdoff value has been given */
 int	log_to_fd = 1;		/* send log messages to this fd too */
 bool	log_default = 1;	/* log_to_fd is default (stdout) */
+bool	async_log = 0;		/* write log messages from a separate thread */
+char	*pcap_file = NULL;	/* record packets to this pcapng file */
+int	pcap_maxsize = 0;	/* rotate pcap_file after this many kbytes */
+int	pcap_interval = 0;	/* rotate pcap_file after this many seconds */
+int	pcap_files = 2;		/* number of pcap_file generations to keep */
+bool	optcache = 0;		/* start from the options last agreed with the peer */
 int	maxfail = 10;		/* max # of unsuccessful connection attempts */
 char	linkname[MAXPATHLEN] = { 0 };	/* logical name for link */
 bool	tune_kernel = FALSE;		/* may alter kernel settings */
@@ -224,6 +233,8 @@ static option_t *find_option __P((const char *name));
 static int process_option __P((option_t *, char *, char **));
 static int n_arguments __P((option_t *));
 static int number_option __P((char *, u_int32_t *, int));
+static void visit_options __P((void (*)(option_t *)));
+static void build_option_hash __P((void));
 
 /*
  * Structure to store extra lists of options.
@@ -234,6 +245,21 @@ struct option_list {
 };
 
 static struct option_list *extra_options = NULL;
+static int option_lists_gen = 0;	/* bumped when extra_options changes */
+
+/*
+ * Option lookup table, built from all the option lists in precedence order
+ * and rebuilt when a plugin adds options or switches the channel.
+ * Exact names are in an open addressing hash table, the first entry with
+ * a given name wins; wildcard options are kept in a list, in order.
+ */
+static option_t **option_hash = NULL;
+static unsigned int option_hash_size = 0;	/* power of 2 */
+static option_t **option_wild = NULL;
+static int option_wild_count = 0;
+static unsigned int option_count;
+static int option_hash_gen = -1;
+static struct channel *option_hash_channel = NULL;
 
 /*
  * Valid arguments.
@@ -292,6 +318,13 @@ option_t general_options[] = {
 
     { "demand", o_bool, &demand,
       "Dial on demand", OPT_INITONLY | 1, &persist },
+    { "demand-hold-packets", o_int, &demand_hold_packets,
+      "Max packets held while dialing on demand", OPT_LLIMIT, 0, 0, 1 },
+    { "demand-hold-bytes", o_int, &demand_hold_bytes,
+      "Max bytes held while dialing on demand", OPT_LLIMIT, 0, 0, 1 },
+    { "demand-hold-flow", o_int, &demand_hold_flow,
+      "Max packets held per flow while dialing on demand",
+      OPT_LLIMIT, 0, 0, 1 },
 
     { "--version", o_special_noarg, (void *)showversion,
       "Show version number" },
@@ -303,6 +336,25 @@ option_t general_options[] = {
     { "logfile", o_special, (void *)setlogfile,
       "Append log messages to this file",
       OPT_PRIO | OPT_A2STRVAL | OPT_STATIC, &logfile_name },
+    { "asynclog", o_bool, &async_log,
+      "Write log messages from a separate thread", 1 },
+    { "noasynclog", o_bool, &async_log,
+      "Write log messages from the main loop", 0 },
+
+    { "pcapfile", o_string, &pcap_file,
+      "Record control packets sent/received to this pcapng file", OPT_PRIO | OPT_PRIV },
+    { "pcapsize", o_int, &pcap_maxsize,
+      "Start a new capture file after this many kbytes" },
+    { "pcaptime", o_int, &pcap_interval,
+      "Start a new capture file after this many seconds" },
+    { "pcapfiles", o_int, &pcap_files,
+      "Number of capture files to keep", OPT_LLIMIT, 0, 0, 1 },
+
+    { "optcache", o_bool, &optcache,
+      "Start negotiation from the options last agreed with the peer", 1 },
+    { "nooptcache", o_bool, &optcache,
+      "Start negotiation from the configured options", 0 },
+
     { "logfd", o_int, &log_to_fd,
       "Send log messages to this file descriptor",
       OPT_PRIOSUB | OPT_A2CLR, &log_default },
@@ -686,38 +738,116 @@ match_option(name, opt, dowild)
 }
 
 /*
- * find_option - scan the option lists for the various protocols
- * looking for an entry with the given name.
- * This could be optimized by using a hash table.
+ * visit_options - call fn for every option, in the order
+ * the option lists are searched.
+ */
+static void
+visit_options(fn)
+    void (*fn) __P((option_t *));
+{
+	option_t *opt;
+	struct option_list *list;
+	int i;
+
+	for (opt = general_options; opt->name != NULL; ++opt)
+		(*fn)(opt);
+	for (opt = auth_options; opt->name != NULL; ++opt)
+		(*fn)(opt);
+	for (list = extra_options; list != NULL; list = list->next)
+		for (opt = list->options; opt->name != NULL; ++opt)
+			(*fn)(opt);
+	for (opt = the_channel->options; opt->name != NULL; ++opt)
+		(*fn)(opt);
+	for (i = 0; protocols[i] != NULL; ++i)
+		if ((opt = protocols[i]->options) != NULL)
+			for (; opt->name != NULL; ++opt)
+				(*fn)(opt);
+}
+
+/*
+ * option_hash_name - hash an option name (FNV-1a).
+ */
+static unsigned int
+option_hash_name(name)
+    const char *name;
+{
+	unsigned int h = 2166136261U;
+
+	while (*name)
+		h = (h ^ (unsigned char) *name++) * 16777619U;
+	return h;
+}
+
+static void
+count_option(opt)
+    option_t *opt;
+{
+	++option_count;
+}
+
+static void
+hash_option(opt)
+    option_t *opt;
+{
+	unsigned int h;
+
+	if (opt->type == o_wild) {
+		option_wild[option_wild_count++] = opt;
+		return;
+	}
+	for (h = option_hash_name(opt->name) & (option_hash_size - 1);
+	     option_hash[h] != NULL; h = (h + 1) & (option_hash_size - 1))
+		if (strcmp(option_hash[h]->name, opt->name) == 0)
+			return;		/* an earlier list has it */
+	option_hash[h] = opt;
+}
+
+/*
+ * build_option_hash - (re)build the option lookup table.
+ */
+static void
+build_option_hash()
+{
+	option_count = 0;
+	visit_options(count_option);
+
+	free(option_hash);
+	free(option_wild);
+	for (option_hash_size = 64; option_hash_size < option_count * 2; )
+		option_hash_size *= 2;
+	option_hash = calloc(option_hash_size, sizeof(option_t *));
+	option_wild = malloc((option_count + 1) * sizeof(option_t *));
+	if (option_hash == NULL || option_wild == NULL)
+		novm("option table");
+	option_wild_count = 0;
+	visit_options(hash_option);
+
+	option_hash_gen = option_lists_gen;
+	option_hash_channel = the_channel;
+}
+
+/*
+ * find_option - look for an entry with the given name in the option
+ * lists for the various protocols; exact names first, then wildcards.
  */
 static option_t *
 find_option(name)
     const char *name;
 {
 	option_t *opt;
-	struct option_list *list;
-	int i, dowild;
-
-	for (dowild = 0; dowild <= 1; ++dowild) {
-		for (opt = general_options; opt->name != NULL; ++opt)
-			if (match_option(name, opt, dowild))
-				return opt;
-		for (opt = auth_options; opt->name != NULL; ++opt)
-			if (match_option(name, opt, dowild))
-				return opt;
-		for (list = extra_options; list != NULL; list = list->next)
-			for (opt = list->options; opt->name != NULL; ++opt)
-				if (match_option(name, opt, dowild))
-					return opt;
-		for (opt = the_channel->options; opt->name != NULL; ++opt)
-			if (match_option(name, opt, dowild))
-				return opt;
-		for (i = 0; protocols[i] != NULL; ++i)
-			if ((opt = protocols[i]->options) != NULL)
-				for (; opt->name != NULL; ++opt)
-					if (match_option(name, opt, dowild))
-						return opt;
-	}
+	unsigned int h;
+	int i;
+
+	if (option_hash_gen != option_lists_gen || option_hash_channel != the_channel)
+		build_option_hash();
+
+	for (h = option_hash_name(name) & (option_hash_size - 1);
+	     (opt = option_hash[h]) != NULL; h = (h + 1) & (option_hash_size - 1))
+		if (strcmp(name, opt->name) == 0)
+			return opt;
+	for (i = 0; i < option_wild_count; ++i)
+		if (match_option(name, option_wild[i], 1))
+			return option_wild[i];
 	return NULL;
 }
 
@@ -996,6 +1126,7 @@ add_options(opt)
     list->options = opt;
     list->next = extra_options;
     extra_options = list;
+    ++option_lists_gen;
 }
 
 /*
@@ -1819,20 +1950,116 @@ loadplugin2(argv)
     return 1;
 }	
 
+/*
+ * Binary block of words being read from the controller, see CONTROLLER_TLV_TAG.
+ */
+static u_char *tlv_buf = NULL;
+static u_char *tlv_ptr, *tlv_end;
+
+/*
+ * tlv_read - read a whole binary block from the controller.
+ */
+static int
+tlv_read()
+{
+    u_int32_t len;
+
+    /* getword leaves the separator after the tag in the stream */
+    if (getc(controlfile) != ' '
+	|| fread(&len, sizeof(len), 1, controlfile) != 1 || len > CONTROLLER_TLV_MAXLEN) {
+	option_error("In controller file descriptor: bad option block");
+	return 0;
+    }
+    free(tlv_buf);
+    if ((tlv_buf = malloc(len ? len : 1)) == NULL)
+	novm("controller option block");
+    if (len && fread(tlv_buf, len, 1, controlfile) != 1) {
+	option_error("In controller file descriptor: truncated option block");
+	return 0;
+    }
+    tlv_ptr = tlv_buf;
+    tlv_end = tlv_buf + len;
+    return 1;
+}
+
+/*
+ * tlv_next - get the next record of the given type from the binary block.
+ */
+static int
+tlv_next(type, datap, lenp)
+    int type;
+    u_char **datap;
+    u_int32_t *lenp;
+{
+    u_int32_t len;
+
+    if (tlv_end - tlv_ptr < 5 || *tlv_ptr != type)
+	return 0;
+    memcpy(&len, tlv_ptr + 1, sizeof(len));
+    if (len > (u_int32_t)(tlv_end - tlv_ptr - 5))
+	return 0;
+    *datap = tlv_ptr + 5;
+    *lenp = len;
+    tlv_ptr += 5 + len;
+    return 1;
+}
+
+/*
+ * controller_word - get the next word from the controller,
+ * out of the binary block if there is one pending.
+ */
+static int
+controller_word(word)
+    char *word;
+{
+    int newline;
+    u_char *data;
+    u_int32_t len;
+
+    if (tlv_buf) {
+	if (tlv_ptr == tlv_end) {
+	    free(tlv_buf);
+	    tlv_buf = NULL;
+	}
+	else {
+	    if (!tlv_next(CONTROLLER_TLV_WORD, &data, &len)
+		|| memchr(data, 0, len)) {
+		option_error("In controller file descriptor: bad word in option block");
+		free(tlv_buf);
+		tlv_buf = NULL;
+		return 0;
+	    }
+	    /* truncate like getword does for text words */
+	    if (len >= MAXWORDLEN) {
+		option_error("warning: word in controller too long (%.20s...)",
+			     (char *)data);
+		len = MAXWORDLEN - 1;
+	    }
+	    memcpy(word, data, len);
+	    word[len] = 0;
+	    return 1;
+	}
+    }
+    return getword(controlfile, word, &newline, "controller");
+}
+
 /*
  * options_from_file - Read a string of options from controller file descriptor,
  * and interpret them.
+ * Options come as text words, or as a binary block read at once.
  */
 int
 options_from_controller()
 {
-    int i, newline, ret;
+    int i, ret;
     option_t *opt;
     int n, oldpriv;
     char *argv[MAXARGS+1]; // +1 because of cfarg
     char args[MAXARGS][MAXWORDLEN];
     char cmd[MAXWORDLEN];
 	char *data = NULL;
+    u_char *tlvdata;
+    u_int32_t tlvlen;
 
     oldpriv = privileged_option;
     privileged_option = controlled;
@@ -1840,12 +2067,17 @@ options_from_controller()
     option_priority = OPRIO_CMDLINE;
     ret = 0;
 
-    while (getword(controlfile, cmd, &newline, "controller")) {
+    while (controller_word(cmd)) {
     
         if (!strcmp(cmd, "[OPTIONS]"))
             continue;
         if (!strcmp(cmd, "[EOP]"))
             break;
+        if (!strcmp(cmd, CONTROLLER_TLV_TAG)) {
+            if (!tlv_read())
+                goto err;
+            continue;
+        }
 
 	opt = find_option(cmd);
 	if (opt == NULL) {
@@ -1857,7 +2089,7 @@ options_from_controller()
 	bzero(args, sizeof(args));
 	n = n_arguments(opt);
 	for (i = 0; i < n; ++i) {
-	    if (!getword(controlfile, args[i], &newline, "controller")) {
+	    if (!controller_word(args[i])) {
 		option_error(
 			"In controller file descriptor: too few parameters for option '%s'",
 			cmd);
@@ -1873,7 +2105,15 @@ options_from_controller()
 			goto err;
 
 		data = malloc(iv);
-		fread(data, iv, 1, controlfile);
+		if (tlv_buf) {
+			if (!tlv_next(CONTROLLER_TLV_DATA, &tlvdata, &tlvlen) || tlvlen != iv) {
+				option_error("In controller file descriptor: bad data for option '%s'", cmd);
+				goto err;
+			}
+			memcpy(data, tlvdata, iv);
+		}
+		else
+			fread(data, iv, 1, controlfile);
 		argv[1] = data;
 	}
 	if (!process_option(opt, cmd, argv))
@@ -1883,6 +2123,10 @@ options_from_controller()
 
 err:
 	if (data) free(data);
+	if (tlv_buf) {
+		free(tlv_buf);
+		tlv_buf = NULL;
+	}
 	privileged_option = oldpriv;
     return ret;
 }
@@ -52,13 +52,20 @@
  * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#ifdef __APPLE__
+#define __STDC_WANT_LIB_EXT1__ 1	/* memset_s */
+#endif
 #include <errno.h>
 #ifdef __APPLE__
 #include <unistd.h>
+#include <string.h>
 #endif
 #include <errno.h>
 #include "pppd.h"
 #include "pppcrypt.h"
+#ifdef __APPLE__
+#include <CommonCrypto/CommonCryptor.h>
+#endif
 
 static u_char
 Get7Bits(input, startBit)
@@ -89,12 +96,68 @@ u_char *des_key;	/* OUT 64 bit DES key with parity bits added */
 	des_key[6] = Get7Bits(key, 42);
 	des_key[7] = Get7Bits(key, 49);
 
-#ifndef USE_CRYPT
+#if !defined(USE_CRYPT) && !defined(__APPLE__)
 	des_set_odd_parity((des_cblock *)des_key);
 #endif
 }
 
-#ifdef USE_CRYPT
+#ifdef __APPLE__
+/*
+ * DES through CommonCrypto, like the digests in chap_ms.c:
+ * no bit-per-byte expansion, and no global state in libc
+ * shared with setkey()/encrypt() users; the key is in the caller's context.
+ */
+static bool
+DesCrypt(ctx, op, in, out)
+des_context *ctx;
+CCOperation op;
+u_char *in;
+u_char *out;
+{
+	size_t	moved = 0;
+
+	if (CCCrypt(op, kCCAlgorithmDES, kCCOptionECBMode, ctx->key,
+		    kCCKeySizeDES, NULL, in, 8, out, 8, &moved) != kCCSuccess
+	    || moved != 8)
+		return (0);
+	return (1);
+}
+
+bool
+DesSetkeyContext(ctx, key)
+des_context *ctx;
+u_char *key;
+{
+	MakeKey(key, ctx->key);
+	return (1);
+}
+
+bool
+DesEncryptContext(ctx, clear, cipher)
+des_context *ctx;
+u_char *clear;	/* IN  8 octets */
+u_char *cipher;	/* OUT 8 octets */
+{
+	return DesCrypt(ctx, kCCEncrypt, clear, cipher);
+}
+
+bool
+DesDecryptContext(ctx, cipher, clear)
+des_context *ctx;
+u_char *cipher;	/* IN  8 octets */
+u_char *clear;	/* OUT 8 octets */
+{
+	return DesCrypt(ctx, kCCDecrypt, cipher, clear);
+}
+
+void
+DesClearkey(ctx)
+des_context *ctx;
+{
+	memset_s(ctx, sizeof(*ctx), 0, sizeof(*ctx));
+}
+
+#elif defined(USE_CRYPT)
 /*
  * in == 8-byte string (expanded version of the 56-bit key)
  * out == 64-byte string where each byte is either 1 or 0
@@ -216,4 +279,48 @@ u_char *clear;	/* OUT 8 octets */
 	return (1);
 }
 
-#endif /* USE_CRYPT */
+#endif /* __APPLE__, USE_CRYPT */
+
+#ifndef __APPLE__
+/*
+ * The libc and libdes keys are global, the context only keeps
+ * the raw key and sets it again before each block.
+ */
+bool
+DesSetkeyContext(ctx, key)
+des_context *ctx;
+u_char *key;
+{
+	BCOPY(key, ctx->key, 7);
+	return (1);
+}
+
+bool
+DesEncryptContext(ctx, clear, cipher)
+des_context *ctx;
+u_char *clear;	/* IN  8 octets */
+u_char *cipher;	/* OUT 8 octets */
+{
+	return (DesSetkey(ctx->key) && DesEncrypt(clear, cipher));
+}
+
+bool
+DesDecryptContext(ctx, cipher, clear)
+des_context *ctx;
+u_char *cipher;	/* IN  8 octets */
+u_char *clear;	/* OUT 8 octets */
+{
+	return (DesSetkey(ctx->key) && DesDecrypt(cipher, clear));
+}
+
+void
+DesClearkey(ctx)
+des_context *ctx;
+{
+	volatile u_char *p = ctx->key;
+	int i;
+
+	for (i = 0; i < sizeof(ctx->key); i++)
+		p[i] = 0;
+}
+#endif /* !__APPLE__ */
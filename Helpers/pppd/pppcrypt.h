@@ -59,12 +59,27 @@
 #include <crypt.h>
 #endif
 
-#ifndef USE_CRYPT
+#if !defined(USE_CRYPT) && !defined(__APPLE__)
 #include <des.h>
 #endif
 
+#ifndef __APPLE__
 extern bool	DesSetkey __P((u_char *));
 extern bool	DesEncrypt __P((u_char *, u_char *));
 extern bool	DesDecrypt __P((u_char *, u_char *));
+#endif
+
+/*
+ * Reentrant DES, the key lives in the caller's context.
+ * DesClearkey must be called once done, to wipe the key.
+ */
+typedef struct des_context {
+	u_char	key[8];
+} des_context;
+
+extern bool	DesSetkeyContext __P((des_context *, u_char *));
+extern bool	DesEncryptContext __P((des_context *, u_char *, u_char *));
+extern bool	DesDecryptContext __P((des_context *, u_char *, u_char *));
+extern void	DesClearkey __P((des_context *));
 
 #endif /* PPPCRYPT_H */
@@ -117,6 +117,16 @@
 #define MAXNAMELEN	256	/* max length of hostname or name for auth */
 #define MAXSECRETLEN	256	/* max length of password or secret */
 
+/*
+ * Binary option block the controller sends in place of text words:
+ * the CONTROLLER_TLV_TAG word, a u_int32_t block length, then records
+ * made of a u_int8_t type, a u_int32_t length and the data, in host order.
+ */
+#define CONTROLLER_TLV_TAG	"[TLV1]"
+#define CONTROLLER_TLV_WORD	'W'	/* one word, as read by getword */
+#define CONTROLLER_TLV_DATA	'D'	/* raw data following an o_special_cfarg length */
+#define CONTROLLER_TLV_MAXLEN	(1024 * 1024)
+
 /*
  * Option descriptor structure.
  */
@@ -287,6 +297,12 @@ extern unsigned	link_connect_time; /* time the link was up for */
 extern int	using_pty;	/* using pty as device (notty or pty opt.) */
 extern int	log_to_fd;	/* logging to this fd as well as syslog */
 extern bool	log_default;	/* log_to_fd is default (stdout) */
+extern bool	async_log;	/* write log messages from a separate thread */
+extern char	*pcap_file;	/* record packets to this pcapng file */
+extern int	pcap_maxsize;	/* rotate pcap_file after this many kbytes */
+extern int	pcap_interval;	/* rotate pcap_file after this many seconds */
+extern int	pcap_files;	/* number of pcap_file generations to keep */
+extern bool	optcache;	/* start from the options last agreed with the peer */
 extern char	*no_ppp_msg;	/* message to print if ppp not in kernel */
 extern volatile int status;	/* exit status for pppd */
 #ifdef __APPLE__
@@ -452,6 +468,9 @@ extern char	our_name[MAXNAMELEN];/* Our name for authentication purposes */
 extern char	remote_name[MAXNAMELEN]; /* Peer's name for authentication */
 extern bool	explicit_remote;/* remote_name specified with remotename opt */
 extern bool	demand;		/* Do dial-on-demand */
+extern int	demand_hold_packets; /* packets held while the link comes up */
+extern int	demand_hold_bytes; /* bytes held while the link comes up */
+extern int	demand_hold_flow; /* packets held per flow */
 extern char	*ipparam;	/* Extra parameter for ip up/down scripts */
 extern bool	cryptpap;	/* Others' PAP passwords are encrypted */
 extern int	idle_time_limit;/* Shut down link if idle for this long */
@@ -718,6 +737,15 @@ void dump_packet __P((const char *, u_char *, int));
 				/* dump packet to debug log if interesting */
 ssize_t complete_read __P((int, void *, size_t));
 				/* read a complete buffer */
+void log_async_start __P((void));	/* start the log writer thread */
+void log_async_stop __P((void));	/* write pending log records and stop */
+void pcap_start __P((void));	/* start recording packets to pcap_file */
+void pcap_stop __P((void));	/* stop recording packets */
+int  optcache_load __P((char *, void *, int));
+				/* get the options cached for the peer */
+void optcache_save __P((char *, void *, int));
+				/* cache the options agreed with the peer */
+void optcache_forget __P((char *));	/* drop the options cached for the peer */
 #ifdef __APPLE__
 void log_vpn_interface_address_event (const char                  *location,
 									  struct kern_event_msg *ev_msg,
@@ -875,6 +903,8 @@ void wait_input __P((struct timeval *));
 				/* Wait for input, with timeout */
 void add_fd __P((int));		/* Add fd to set to wait for */
 void remove_fd __P((int));	/* Remove fd from set to wait for */
+void add_fd_handler __P((int, void (*)(int, void *), void *));
+				/* Add fd, with a routine to call when ready */
 #ifdef __APPLE__
 void sys_runloop __P((void));	/* Do system-dependent runloop action */
 int save_new_password(void); /* save new password to the keychain */
@@ -885,6 +915,9 @@ int sys_check_controller(void);
 int sys_setup_security_session(void);
 int sys_loadplugin(char *arg);
 void sys_publish_remoteaddress(char *addr);
+void sys_publish_lcp_rtt(u_int32_t min, u_int32_t avg, u_int32_t max,
+			 u_int32_t srtt, u_int32_t *hist, int nhist);
+				/* publish the LCP echo round-trip times */
 int getabsolutetime(struct timeval *timenow);
 bool is_ready_fd(int fd);	/* check if fd is ready (out of select) */
 void set_up_tty_local __P((int, int)); /* Set up port's 'local' parameters only. */
@@ -67,6 +67,7 @@
 #include <sys/wait.h>
 #include <sys/un.h>
 #include <sys/ucred.h>
+#include <sys/event.h>
 #import "acsp.h"
 #ifdef PPP_FILTER
 #include <net/bpf.h>
@@ -163,6 +164,7 @@ static int make_ppp_unit(void);
 /* Prototypes for procedures local to this file. */
 static int get_ether_addr __P((u_int32_t, struct sockaddr_dl *));
 static int connect_pfppp(void);
+static void poll_init(void);
 //static void sys_pidchange(void *arg, int pid);
 static void sys_phasechange(void *arg, uintptr_t phase);
 static void sys_exitnotify(void *arg, uintptr_t exitcode);
@@ -184,6 +186,8 @@ static int update_stateaddr(u_int32_t o, u_int32_t h, u_int32_t m);
 int publish_stateaddr(u_int32_t o, u_int32_t h, u_int32_t m);
 int route_interface(int cmd, struct in_addr host, struct in_addr mask, char iftype, char *ifname, int is_host);
 int route_gateway(int cmd, struct in_addr dest, struct in_addr mask, struct in_addr gateway, int use_gway_flag);
+void route_batch_begin(void);
+void route_batch_end(void);
 static void ppp_ip_probe_timeout (void *arg);
 static void republish_dict(SCDynamicStoreRef store, void *info);
 static int commit_publish_dict(void);
@@ -208,15 +212,43 @@ static struct winsize 	wsinfo;			/* Initial window size info */
 
 static int 		ip_sockfd;		/* socket for doing interface ioctls */
 
-static fd_set 		in_fds;			/* set of fds that wait_input waits for */
-static fd_set 		ready_fds;		/* set of fds currently ready (out of select) */
-static int 		max_in_fd;		/* highest fd set in in_fds */
+/* fds wait_input waits for, indexed by fd */
+struct poll_fd {
+    u_char		registered;		/* fd is in the set */
+    u_char		ready;			/* fd was ready when wait_input returned */
+    void		(*handler) __P((int, void *)); /* called by wait_input when ready */
+    void		*arg;
+};
+
+/* backend used by wait_input, kqueue if available, select otherwise */
+struct poller {
+    char		*name;
+    int			(*init) __P((void));
+    int			(*add) __P((int));
+    void		(*remove) __P((int));
+    int			(*wait) __P((struct timeval *));
+};
+
+static struct poll_fd	*poll_fds;		/* set of fds that wait_input waits for */
+static int		poll_fds_size;		/* allocated entries in poll_fds */
+static int 		max_in_fd;		/* highest fd set in poll_fds */
+static struct poller	*poller;		/* current poller backend */
+static int		poll_kq = -1;		/* kqueue descriptor */
+static pid_t		poll_kq_pid;		/* process owning poll_kq */
+#define POLL_KQ_EVENTS	32
+static int		poll_ready[POLL_KQ_EVENTS]; /* fds marked ready by the last kqueue wait */
+static int		poll_nready;
+static fd_set 		in_fds;			/* set of fds for select */
 
 static int 		if_is_up;		/* the interface is currently up */
 static int		ipv4_plumbed = 0; 	/* is ipv4 plumbed on the interface ? */
 static u_int32_t 	ifaddrs[2];		/* local and remote addresses we set */
 static u_int32_t 	default_route_gateway;	/* gateway addr for default route */
 static u_int32_t 	proxy_arp_addr;		/* remote addr for proxy arp */
+static int		route_batch_fd = -1;	/* routing socket shared by a route batch */
+static int		route_batch_msgs;	/* messages written in the current batch */
+static int		route_batch_failed;	/* additions rejected in the current batch */
+static int		route_batch_errno;	/* last error seen in the current batch */
 SCDynamicStoreRef	cfgCache = 0;		/* configd session */
 CFRunLoopSourceRef	rls = 0;		/* runloop source */
 CFStringRef		serviceidRef = 0;	/* service id ref */
@@ -865,8 +897,8 @@ void sys_init()
     }
 
     FD_ZERO(&in_fds);
-    FD_ZERO(&ready_fds);
     max_in_fd = 0;
+    poll_init();
 }
 
 /* ----------------------------------------------------------------------------- 
@@ -980,6 +1012,7 @@ void sys_close()
 	ip_sockfd = -1;
     }
     if (ppp_sockfd != -1) {
+        remove_fd(ppp_sockfd);
         close(ppp_sockfd);
         ppp_sockfd = -1;
     }
@@ -1601,6 +1634,7 @@ void output(int unit, u_char *p, int len)
 {
 
     dump_packet("sent", p, len);
+    if (snoop_send_hook) snoop_send_hook(p, len);
     
     // don't write FF03
     len -= 2;
@@ -1616,22 +1650,189 @@ void output(int unit, u_char *p, int len)
     }
 }
 
+/* -----------------------------------------------------------------------------
+kqueue poller
+----------------------------------------------------------------------------- */
+static int poll_kq_init()
+{
+    struct kevent	kev;
+    int			fd;
+
+    // after a fork, the kqueue is gone and its number may be in use
+    if (poll_kq >= 0 && poll_kq_pid == getpid())
+        close(poll_kq);
+    if ((poll_kq = kqueue()) < 0)
+        return -1;
+    poll_kq_pid = getpid();
+    fcntl(poll_kq, F_SETFD, FD_CLOEXEC);
+
+    // register again the fds we already wait for
+    for (fd = 0; fd <= max_in_fd && fd < poll_fds_size; fd++)
+        if (poll_fds[fd].registered) {
+            EV_SET(&kev, fd, EVFILT_READ, EV_ADD, 0, 0, 0);
+            kevent(poll_kq, &kev, 1, NULL, 0, NULL);
+        }
+    return 0;
+}
+
+static int poll_kq_add(int fd)
+{
+    struct kevent	kev;
+
+    EV_SET(&kev, fd, EVFILT_READ, EV_ADD, 0, 0, 0);
+    if (kevent(poll_kq, &kev, 1, NULL, 0, NULL) < 0) {
+        error("kevent add fd %d: %m", fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void poll_kq_remove(int fd)
+{
+    struct kevent	kev;
+
+    // the fd may already be closed, and then gone from the kqueue
+    EV_SET(&kev, fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
+    kevent(poll_kq, &kev, 1, NULL, 0, NULL);
+}
+
+static int poll_kq_wait(struct timeval *timo)
+{
+    struct kevent	kev[POLL_KQ_EVENTS];
+    struct timespec	ts, *tsp = NULL;
+    int			i, n, fd;
+
+    if (timo) {
+        ts.tv_sec = timo->tv_sec;
+        ts.tv_nsec = timo->tv_usec * 1000;
+        tsp = &ts;
+    }
+
+    n = kevent(poll_kq, NULL, 0, kev, POLL_KQ_EVENTS, tsp);
+    for (i = 0; i < n; i++) {
+        fd = (int)kev[i].ident;
+        if (fd < poll_fds_size && poll_fds[fd].registered) {
+            poll_fds[fd].ready = 1;
+            poll_ready[poll_nready++] = fd;
+        }
+    }
+    return n;
+}
+
+static struct poller poll_kq_poller = {
+    "kqueue", poll_kq_init, poll_kq_add, poll_kq_remove, poll_kq_wait
+};
+
+/* -----------------------------------------------------------------------------
+select poller, used if kqueue is not available
+----------------------------------------------------------------------------- */
+static int poll_select_init()
+{
+    int		fd;
+
+    // kqueue may have failed after a fork, register again the fds we already wait for
+    FD_ZERO(&in_fds);
+    for (fd = 0; fd <= max_in_fd && fd < poll_fds_size; fd++)
+        if (poll_fds[fd].registered) {
+            if (fd >= FD_SETSIZE)
+                fatal("fd %d too large for select", fd);
+            FD_SET(fd, &in_fds);
+        }
+    return 0;
+}
+
+static int poll_select_add(int fd)
+{
+    if (fd >= FD_SETSIZE)
+        fatal("fd %d too large for select", fd);
+    FD_SET(fd, &in_fds);
+    return 0;
+}
+
+static void poll_select_remove(int fd)
+{
+    if (fd < FD_SETSIZE)
+        FD_CLR(fd, &in_fds);
+}
+
+static int poll_select_wait(struct timeval *timo)
+{
+    fd_set	ready_fds;
+    int		n, fd;
+
+    ready_fds = in_fds;
+    n = select(max_in_fd + 1, &ready_fds, NULL, NULL, timo);
+    for (fd = 0; n > 0 && fd <= max_in_fd && fd < FD_SETSIZE; fd++)
+        if (FD_ISSET(fd, &ready_fds))
+            poll_fds[fd].ready = 1;
+    return n;
+}
+
+static struct poller poll_select_poller = {
+    "select", poll_select_init, poll_select_add, poll_select_remove, poll_select_wait
+};
+
+/* -----------------------------------------------------------------------------
+choose the poller backend, called at init time and again after a fork,
+as the kqueue is not inherited by the child
+----------------------------------------------------------------------------- */
+static void poll_init()
+{
+    poller = &poll_kq_poller;
+    if ((*poller->init)() < 0) {
+        warning("kqueue unavailable (%m), using select");
+        poller = &poll_select_poller;
+        (*poller->init)();
+    }
+}
+
+/* -----------------------------------------------------------------------------
+forget the fds found ready by the previous wait
+----------------------------------------------------------------------------- */
+static void poll_clear_ready()
+{
+    int		fd;
+
+    if (poller == &poll_kq_poller) {
+        while (poll_nready)
+            poll_fds[poll_ready[--poll_nready]].ready = 0;
+        return;
+    }
+    for (fd = 0; fd <= max_in_fd && fd < poll_fds_size; fd++)
+        poll_fds[fd].ready = 0;
+}
+
 /* -----------------------------------------------------------------------------
 wait until there is data available, for the length of time specified by *timo
 (indefinite if timo is NULL)
+fds with a handler are serviced before returning
 ----------------------------------------------------------------------------- */
 void wait_input(struct timeval *timo)
 {
-    int n;
+    int n, i, fd;
 
-    ready_fds = in_fds;
-    n = select(max_in_fd + 1, &ready_fds, NULL, NULL, timo);
-   if (n < 0 && errno != EINTR)
-	fatal("select: %m");
+    poll_clear_ready();
+    n = (*poller->wait)(timo);
+    if (n < 0 && errno != EINTR)
+	fatal("%s: %m", poller->name);
 
-   if (n < 0) {
-        FD_ZERO(&ready_fds);
-   }
+    if (n < 0) {
+        poll_clear_ready();
+        return;
+    }
+
+    // a handler may remove fds, or add new ones and grow poll_fds
+    if (poller == &poll_kq_poller) {
+        for (i = 0; i < poll_nready; i++) {
+            fd = poll_ready[i];
+            if (fd < poll_fds_size && poll_fds[fd].ready && poll_fds[fd].handler)
+                (*poll_fds[fd].handler)(fd, poll_fds[fd].arg);
+        }
+        return;
+    }
+    for (fd = 0; n > 0 && fd <= max_in_fd && fd < poll_fds_size; fd++)
+        if (poll_fds[fd].ready && poll_fds[fd].handler)
+            (*poll_fds[fd].handler)(fd, poll_fds[fd].arg);
 }
 
 /* -----------------------------------------------------------------------------
@@ -1667,17 +1868,56 @@ add an fd to the set that wait_input waits for
 ----------------------------------------------------------------------------- */
 void add_fd(int fd)
 {
-    FD_SET(fd, &in_fds);
+    if (fd < 0)
+        return;
+
+    if (fd >= poll_fds_size) {
+        int size = poll_fds_size ? poll_fds_size : 64;
+        struct poll_fd *fds;
+
+        while (size <= fd)
+            size *= 2;
+        if ((fds = realloc(poll_fds, size * sizeof(struct poll_fd))) == NULL)
+            novm("fd set");
+        bzero(&fds[poll_fds_size], (size - poll_fds_size) * sizeof(struct poll_fd));
+        poll_fds = fds;
+        poll_fds_size = size;
+    }
+
+    // always hand the fd to the poller, even if already registered:
+    // an fd closed without remove_fd is gone from the kqueue, and its number
+    // may have been reused since. adding twice is harmless for both backends
+    if ((*poller->add)(fd) == 0)
+        poll_fds[fd].registered = 1;
+    else
+        bzero(&poll_fds[fd], sizeof(struct poll_fd));
     if (fd > max_in_fd)
 	max_in_fd = fd;
 }
 
+/* -----------------------------------------------------------------------------
+add an fd to the set that wait_input waits for, 
+and have wait_input call handler when it's ready
+----------------------------------------------------------------------------- */
+void add_fd_handler(int fd, void (*handler) __P((int, void *)), void *arg)
+{
+    add_fd(fd);
+    if (fd >= 0 && poll_fds[fd].registered) {
+        poll_fds[fd].handler = handler;
+        poll_fds[fd].arg = arg;
+    }
+}
+
 /* -----------------------------------------------------------------------------
 remove an fd from the set that wait_input waits for
 ----------------------------------------------------------------------------- */
 void remove_fd(int fd)
 {
-    FD_CLR(fd, &in_fds);
+    if (fd < 0 || fd >= poll_fds_size || !poll_fds[fd].registered)
+        return;
+
+    (*poller->remove)(fd);
+    bzero(&poll_fds[fd], sizeof(struct poll_fd));
 }
 
 /* -----------------------------------------------------------------------------
@@ -1685,7 +1925,7 @@ return 1 is fd is set (i.e. select returned with this file descriptor set)
 ----------------------------------------------------------------------------- */
 bool is_ready_fd(int fd)
 {
-    return (FD_ISSET(fd, &ready_fds) != 0);
+    return (fd >= 0 && fd < poll_fds_size && poll_fds[fd].ready);
 }
 
 /* -----------------------------------------------------------------------------
@@ -3811,11 +4051,45 @@ void sys_publish_remoteaddress(char *addr)
         publish_dictstrentry(kSCEntNetPPP, kSCPropNetPPPCommRemoteAddress, addr, kCFStringEncodingUTF8);
 }
 
+/* -----------------------------------------------------------------------------
+publish the round-trip times measured with LCP echos, in microseconds,
+and their histogram (see struct lcp_rtt)
+----------------------------------------------------------------------------- */
+void sys_publish_lcp_rtt(u_int32_t min, u_int32_t avg, u_int32_t max, u_int32_t srtt, u_int32_t *hist, int nhist)
+{
+    CFStringRef		key;
+    CFMutableArrayRef	array;
+    CFNumberRef		num;
+    int			i;
+
+    publish_dictnumentry(kSCEntNetPPP, CFSTR("LCPEchoRTTMin"), min);
+    publish_dictnumentry(kSCEntNetPPP, CFSTR("LCPEchoRTTAvg"), avg);
+    publish_dictnumentry(kSCEntNetPPP, CFSTR("LCPEchoRTTMax"), max);
+    publish_dictnumentry(kSCEntNetPPP, CFSTR("LCPEchoRTTSmoothed"), srtt);
+
+    key = SCDynamicStoreKeyCreateNetworkServiceEntity(0, kSCDynamicStoreDomainState, serviceidRef, kSCEntNetPPP);
+    if (key == NULL)
+        return;
+    if ((array = CFArrayCreateMutable(0, nhist, &kCFTypeArrayCallBacks))) {
+        for (i = 0; i < nhist; i++) {
+            if ((num = CFNumberCreate(NULL, kCFNumberSInt32Type, &hist[i]))) {
+                CFArrayAppendValue(array, num);
+                CFRelease(num);
+            }
+        }
+        publish_keyentry(key, CFSTR("LCPEchoRTTHistogram"), array);
+        CFRelease(array);
+    }
+    CFRelease(key);
+}
+
 /* -----------------------------------------------------------------------------
 our pid has changed, reinit things
 ----------------------------------------------------------------------------- */
 void sys_reinit()
 {
+    // kqueues are not inherited across fork
+    poll_init();
     
     cfgCache = SCDynamicStoreCreate(0, CFSTR("pppd"), 0, 0);
     if (cfgCache == 0)
@@ -3852,14 +4126,89 @@ void sys_exitnotify(void *arg, uintptr_t exitcode)
 	}
 }
 
+/* -----------------------------------------------------------------------------
+start a route batch
+all the route_interface and route_gateway calls until route_batch_end are
+written on the same routing socket, instead of opening one per route.
+the kernel reports errors synchronously on write, so nothing needs to be
+read back, and the loopback copy of our own messages is turned off
+----------------------------------------------------------------------------- */
+void
+route_batch_begin(void)
+{
+    int 	off = 0;
+
+    if (route_batch_fd >= 0)
+        return;
+
+    route_batch_msgs = 0;
+    route_batch_failed = 0;
+    route_batch_errno = 0;
+    if ((route_batch_fd = socket(PF_ROUTE, SOCK_RAW, PF_ROUTE)) < 0) {
+        // not fatal, each route will open its own socket
+        sys_log(LOG_INFO, "route_batch_begin: open routing socket failed, %s.", strerror(errno));
+        return;
+    }
+    setsockopt(route_batch_fd, SOL_SOCKET, SO_USELOOPBACK, &off, sizeof(off));
+}
+
+/* -----------------------------------------------------------------------------
+end a route batch, and report the errors collected
+----------------------------------------------------------------------------- */
+void
+route_batch_end(void)
+{
+    if (route_batch_fd < 0)
+        return;
+
+    close(route_batch_fd);
+    route_batch_fd = -1;
+    if (route_batch_failed)
+        sys_log(LOG_ERR, "route batch: %d of %d routing socket writes rejected, last error %s.",
+                route_batch_failed, route_batch_msgs, strerror(route_batch_errno));
+    else if (route_batch_msgs)
+        dbglog("route batch: %d routing socket writes", route_batch_msgs);
+}
+
+/* -----------------------------------------------------------------------------
+write a routing message, on the batch socket if one is open.
+return 0 on success, and the error otherwise
+----------------------------------------------------------------------------- */
+static int
+route_write(void *msg, int len)
+{
+    static int	rtm_seq = 0;
+    int 	sockfd, err = 0;
+
+    if ((sockfd = route_batch_fd) < 0
+        && (sockfd = socket(PF_ROUTE, SOCK_RAW, PF_ROUTE)) < 0)
+        return (errno ? errno : EIO);
+
+    ((struct rt_msghdr *)msg)->rtm_seq = ++rtm_seq;
+    if (write(sockfd, msg, len) < 0)
+        err = errno;
+
+    if (sockfd != route_batch_fd) {
+        close(sockfd);
+        return (err);
+    }
+
+    // deleting a route already gone with the interface is expected
+    route_batch_msgs++;
+    if (err && ((struct rt_msghdr *)msg)->rtm_type != RTM_DELETE) {
+        route_batch_failed++;
+        route_batch_errno = err;
+    }
+    return (err);
+}
+
 /* -----------------------------------------------------------------------------
 add/remove a route via an interface
 ----------------------------------------------------------------------------- */
 int
 route_interface(int cmd, struct in_addr host, struct in_addr addr_mask, char iftype, char *ifname, int is_host)
 {
-	int 			len, iflen;
-    int 			rtm_seq = 0;
+	int 			len, iflen, err;
     struct {
 	struct rt_msghdr	hdr;
 	struct sockaddr_in	dst;
@@ -3869,16 +4218,6 @@ route_interface(int cmd, struct in_addr host, struct in_addr addr_mask, char ift
     
 	char            host_str[INET_ADDRSTRLEN];
 	char            mask_str[INET_ADDRSTRLEN];
-    int 			sockfd = -1;
-
-    if ((sockfd = socket(PF_ROUTE, SOCK_RAW, PF_ROUTE)) < 0) {
-		error("route_interface: open routing socket failed, %m. (address %s, mask %s, interface %s, host %d).",
-			  addr2ascii(AF_INET, &host, sizeof(host), host_str),
-			  addr2ascii(AF_INET, &addr_mask, sizeof(addr_mask), mask_str),
-			  ifname,
-			  is_host);
-		return (0);
-    }
 
     memset(&rtmsg, 0, sizeof(rtmsg));
     rtmsg.hdr.rtm_type = cmd;
@@ -3886,7 +4225,6 @@ route_interface(int cmd, struct in_addr host, struct in_addr addr_mask, char ift
     if (is_host)
         rtmsg.hdr.rtm_flags |= RTF_HOST;
     rtmsg.hdr.rtm_version = RTM_VERSION;
-    rtmsg.hdr.rtm_seq = ++rtm_seq;
     rtmsg.hdr.rtm_addrs = RTA_DST | RTA_GATEWAY;
     rtmsg.dst.sin_len = sizeof(rtmsg.dst);
     rtmsg.dst.sin_family = AF_INET;
@@ -3908,18 +4246,17 @@ route_interface(int cmd, struct in_addr host, struct in_addr addr_mask, char ift
 
     len = sizeof(rtmsg);
     rtmsg.hdr.rtm_msglen = len;
-    if (write(sockfd, &rtmsg, len) < 0) {
-		sys_log((cmd == RTM_DELETE)? LOG_DEBUG : LOG_ERR, "route_interface: write routing socket failed, %s. (address %s, mask %s, interface %s, host %d).",
-			   strerror(errno),
+    if ((err = route_write(&rtmsg, len))) {
+		// in a batch, failures are summarized by route_batch_end
+		sys_log((cmd == RTM_DELETE || route_batch_fd >= 0)? LOG_DEBUG : LOG_ERR, "route_interface: write routing socket failed, %s. (address %s, mask %s, interface %s, host %d).",
+			   strerror(err),
 			  addr2ascii(AF_INET, &host, sizeof(host), host_str),
 			  addr2ascii(AF_INET, &addr_mask, sizeof(addr_mask), mask_str),
 			  ifname,
 			  is_host);
-		close(sockfd);
 		return (0);
     }
 
-    close(sockfd);
     return (1);
 }
 
@@ -3932,8 +4269,7 @@ route_gateway(int cmd, struct in_addr dest, struct in_addr mask, struct in_addr
 	char            dest_str[INET_ADDRSTRLEN];
 	char            mask_str[INET_ADDRSTRLEN];
 	char            gateway_str[INET_ADDRSTRLEN];
-    int 			len;
-    int 			rtm_seq = 0;
+    int 			len, err;
 
     struct {
 	struct rt_msghdr	hdr;
@@ -3941,18 +4277,6 @@ route_gateway(int cmd, struct in_addr dest, struct in_addr mask, struct in_addr
         struct sockaddr_in	gway;
         struct sockaddr_in	mask;
     } rtmsg;
-   
-    int 			sockfd = -1;
-    
-    if ((sockfd = socket(PF_ROUTE, SOCK_RAW, PF_ROUTE)) < 0) {
-		sys_log(LOG_INFO, "host_gateway: open routing socket failed, %s. (address %s, mask %s, gateway %s, use-gateway %d).",
-			   strerror(errno),
-			   addr2ascii(AF_INET, &dest, sizeof(dest), dest_str),
-			   addr2ascii(AF_INET, &mask, sizeof(mask), mask_str),
-			   addr2ascii(AF_INET, &gateway, sizeof(gateway), gateway_str),
-			   use_gway_flag);
-		return (0);
-    }
 
     memset(&rtmsg, 0, sizeof(rtmsg));
     rtmsg.hdr.rtm_type = cmd;
@@ -3960,7 +4284,6 @@ route_gateway(int cmd, struct in_addr dest, struct in_addr mask, struct in_addr
     if (use_gway_flag)
         rtmsg.hdr.rtm_flags |= RTF_GATEWAY;
     rtmsg.hdr.rtm_version = RTM_VERSION;
-    rtmsg.hdr.rtm_seq = ++rtm_seq;
     rtmsg.hdr.rtm_addrs = RTA_DST | RTA_NETMASK | RTA_GATEWAY;
     rtmsg.dst.sin_len = sizeof(rtmsg.dst);
     rtmsg.dst.sin_family = AF_INET;
@@ -3974,18 +4297,17 @@ route_gateway(int cmd, struct in_addr dest, struct in_addr mask, struct in_addr
 
     len = sizeof(rtmsg);
     rtmsg.hdr.rtm_msglen = len;
-    if (write(sockfd, &rtmsg, len) < 0) {
-		sys_log((cmd == RTM_DELETE)? LOG_DEBUG : LOG_ERR, "host_gateway: write routing socket failed, %s. (address %s, mask %s, gateway %s, use-gateway %d).",
-			   strerror(errno),
+    if ((err = route_write(&rtmsg, len))) {
+		// in a batch, failures are summarized by route_batch_end
+		sys_log((cmd == RTM_DELETE || route_batch_fd >= 0)? LOG_DEBUG : LOG_ERR, "host_gateway: write routing socket failed, %s. (address %s, mask %s, gateway %s, use-gateway %d).",
+			   strerror(err),
 			   addr2ascii(AF_INET, &dest, sizeof(dest), dest_str),
 			   addr2ascii(AF_INET, &mask, sizeof(mask), mask_str),
 			   addr2ascii(AF_INET, &gateway, sizeof(gateway), gateway_str),
 			   use_gway_flag);
-		close(sockfd);
 		return (0);
     }
 
-    close(sockfd);
     return (1);
 }
 
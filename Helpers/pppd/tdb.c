@@ -50,7 +50,7 @@
 #include <sys/stat.h>
 #include "tdb.h"
 
-#define TDB_VERSION (0x26011967 + 1)
+#define TDB_VERSION (0x26011967 + 2)
 #define TDB_MAGIC (0x26011999U)
 #define TDB_FREE_MAGIC (~TDB_MAGIC)
 #define TDB_ALIGN 4
@@ -58,7 +58,8 @@
 #define DEFAULT_HASH_SIZE 128
 #define TDB_PAGE_SIZE 0x2000
 #define TDB_LEN_MULTIPLIER 10
-#define FREELIST_TOP (sizeof(struct tdb_header))
+#define TDB_FREE_LISTS 8
+#define FREELIST_TOP(c) (sizeof(struct tdb_header) + (c)*sizeof(tdb_off))
 
 #define LOCK_SET 1
 #define LOCK_CLEAR 0
@@ -74,6 +75,10 @@
 #define MAP_FILE 0
 #endif
 
+#ifndef HAVE_MMAP
+#define HAVE_MMAP 1
+#endif
+
 /* the body of the database is made of one list_struct for the free space
    plus a separate data list for each hash value */
 struct list_struct {
@@ -201,10 +206,22 @@ static tdb_off tdb_hash_top(TDB_CONTEXT *tdb, unsigned hash)
 {
 	tdb_off ret;
 	hash = BUCKET(hash);
-	ret = FREELIST_TOP + (hash+1)*sizeof(tdb_off);
+	ret = FREELIST_TOP(TDB_FREE_LISTS + hash);
 	return ret;
 }
 
+/* free records are kept in lists by size class, so that an allocation
+   only walks the lists that can satisfy it: class c holds records of
+   less than 64 << c bytes, and the last class everything bigger */
+static int tdb_free_class(tdb_len len)
+{
+	int c;
+
+	for (c = 0; c < TDB_FREE_LISTS - 1 && len >= (64U << c); c++)
+		;
+	return c;
+}
+
 
 /* check for an out of bounds access - if it is out of bounds then
    see if the database has been expanded by someone else and expand
@@ -301,6 +318,31 @@ static char *tdb_alloc_read(TDB_CONTEXT *tdb, tdb_off offset, tdb_len len)
 	return buf;
 }
 
+/* compare a lump of data at a specified offset with buf, in place
+   when the database is mapped. 0 is returned if they match, 1 if they
+   don't and -1 on error */
+static int tdb_cmp(TDB_CONTEXT *tdb, tdb_off offset, const char *buf, tdb_len len)
+{
+	char *data;
+	int ret;
+
+	if (tdb_oob(tdb, offset + len) != 0) {
+		return -1;
+	}
+
+	if (tdb->map_ptr) {
+		return memcmp(offset + (char *)tdb->map_ptr, buf, len) != 0;
+	}
+
+	data = tdb_alloc_read(tdb, offset, len);
+	if (!data) {
+		return -1;
+	}
+	ret = memcmp(data, buf, len) != 0;
+	free(data);
+	return ret;
+}
+
 /* convenience routine for writing a record */
 static int rec_write(TDB_CONTEXT *tdb, tdb_off offset, struct list_struct *rec)
 {
@@ -337,6 +379,22 @@ static int rec_read(TDB_CONTEXT *tdb, tdb_off offset, struct list_struct *rec)
 	return 0;
 }
 
+/* put a record on the free list of its size class, the caller holds
+   the global lock */
+static int tdb_free_push(TDB_CONTEXT *tdb, tdb_off rec_ptr, struct list_struct *rec)
+{
+	tdb_off offset = FREELIST_TOP(tdb_free_class(rec->rec_len));
+
+	if (ofs_read(tdb, offset, &rec->next) == -1) {
+		return -1;
+	}
+	rec->magic = TDB_FREE_MAGIC;
+	if (rec_write(tdb, rec_ptr, rec) == -1) {
+		return -1;
+	}
+	return ofs_write(tdb, offset, &rec_ptr);
+}
+
 /* expand the database at least length bytes by expanding the
    underlying file and doing the mmap again if necessary */
 static int tdb_expand(TDB_CONTEXT *tdb, tdb_off length)
@@ -364,8 +422,8 @@ static int tdb_expand(TDB_CONTEXT *tdb, tdb_off length)
         }
 
 	/* form a new freelist record */
-	offset = FREELIST_TOP;
 	rec.rec_len = length - sizeof(rec);
+	offset = FREELIST_TOP(tdb_free_class(rec.rec_len));
 	rec.magic = TDB_FREE_MAGIC;
 	if (ofs_read(tdb, offset, &rec.next) == -1) {
 		goto fail;
@@ -412,7 +470,7 @@ static int tdb_expand(TDB_CONTEXT *tdb, tdb_off length)
 	return -1;
 }
 
-/* allocate some space from the free list. The offset returned points
+/* allocate some space from the free lists. The offset returned points
    to a unconnected list_struct within the database with room for at
    least length bytes of total data
 
@@ -422,76 +480,76 @@ static tdb_off tdb_allocate(TDB_CONTEXT *tdb, tdb_len length)
 {
 	tdb_off offset, rec_ptr, last_ptr;
 	struct list_struct rec, lastrec, newrec;
+	int c;
 
 	tdb_lock(tdb, -1);
 
  again:
-	last_ptr = 0;
-	offset = FREELIST_TOP;
+	/* records in the lists of bigger classes are all big enough,
+	   the list of our own class may need a walk */
+	for (c = tdb_free_class(length); c < TDB_FREE_LISTS; c++) {
+		last_ptr = 0;
+		offset = FREELIST_TOP(c);
 
-	/* read in the freelist top */
-	if (ofs_read(tdb, offset, &rec_ptr) == -1) {
-		goto fail;
-	}
-
-	/* keep looking until we find a freelist record that is big
-           enough */
-	while (rec_ptr) {
-		if (tdb_read(tdb, rec_ptr, (char *)&rec, sizeof(rec)) == -1) {
+		/* read in the freelist top */
+		if (ofs_read(tdb, offset, &rec_ptr) == -1) {
 			goto fail;
 		}
 
-		if (rec.magic != TDB_FREE_MAGIC) {
+		/* keep looking until we find a freelist record that is big
+		   enough */
+		while (rec_ptr) {
+			if (tdb_read(tdb, rec_ptr, (char *)&rec, sizeof(rec)) == -1) {
+				goto fail;
+			}
+
+			if (rec.magic != TDB_FREE_MAGIC) {
 #if TDB_DEBUG
-			printf("bad magic 0x%08x in free list\n", rec.magic);
+				printf("bad magic 0x%08x in free list\n", rec.magic);
 #endif
-			goto fail;
-		}
+				goto fail;
+			}
 
-		if (rec.rec_len >= length) {
-			/* found it - now possibly split it up  */
-			if (rec.rec_len > length + MIN_REC_SIZE) {
-				length = (length + TDB_ALIGN) & ~(TDB_ALIGN-1);
+			if (rec.rec_len >= length) {
+				/* found it - remove it from the list */
+				if (last_ptr == 0) {
+					if (ofs_write(tdb, offset, &rec.next) == -1) {
+						goto fail;
+					}
+				} else {
+					lastrec.next = rec.next;
+					if (rec_write(tdb, last_ptr, &lastrec) == -1) {
+						goto fail;
+					}
+				}
 
-				newrec.rec_len = rec.rec_len - (sizeof(rec) + length);
-				newrec.next = rec.next;
-				newrec.magic = TDB_FREE_MAGIC;
+				/* now possibly split it up, the rest goes
+				   to the list of its own size */
+				if (rec.rec_len > length + MIN_REC_SIZE) {
+					length = (length + TDB_ALIGN) & ~(TDB_ALIGN-1);
 
-				rec.rec_len = length;
-				rec.next = rec_ptr + sizeof(rec) + rec.rec_len;
-				
-				if (rec_write(tdb, rec.next, &newrec) == -1) {
-					goto fail;
+					newrec.rec_len = rec.rec_len - (sizeof(rec) + length);
+					rec.rec_len = length;
+					if (tdb_free_push(tdb, rec_ptr + sizeof(rec) + length, &newrec) == -1) {
+						goto fail;
+					}
 				}
 
+				rec.next = 0;
 				if (rec_write(tdb, rec_ptr, &rec) == -1) {
 					goto fail;
 				}
-			}
 
-			/* remove it from the list */
-			if (last_ptr == 0) {
-				offset = FREELIST_TOP;
-
-				if (ofs_write(tdb, offset, &rec.next) == -1) {
-					goto fail;
-				}				
-			} else {
-				lastrec.next = rec.next;
-				if (rec_write(tdb, last_ptr, &lastrec) == -1) {
-					goto fail;
-				}
+				/* all done - return the new record offset */
+				tdb_unlock(tdb, -1);
+				return rec_ptr;
 			}
 
-			/* all done - return the new record offset */
-			tdb_unlock(tdb, -1);
-			return rec_ptr;
+			/* move to the next record */
+			lastrec = rec;
+			last_ptr = rec_ptr;
+			rec_ptr = rec.next;
 		}
-
-		/* move to the next record */
-		lastrec = rec;
-		last_ptr = rec_ptr;
-		rec_ptr = rec.next;
 	}
 
 	/* we didn't find enough space. See if we can expand the
@@ -532,7 +590,7 @@ static int tdb_new_database(TDB_CONTEXT *tdb, int hash_size)
         offset = 0;
         memset(buf, 0, sizeof(buf));
 
-        for (i=0;(hash_size+1)-i >= 16; i += 16) {
+        for (i=0;(hash_size+TDB_FREE_LISTS)-i >= 16; i += 16) {
             if (tdb->fd != -1 && write(tdb->fd, buf, sizeof(buf)) != 
                 sizeof(buf)) {
                 tdb->ecode = TDB_ERR_IO;
@@ -540,7 +598,7 @@ static int tdb_new_database(TDB_CONTEXT *tdb, int hash_size)
             } else size += sizeof(buf);
         }
 
-        for (;i<hash_size+1; i++) {
+        for (;i<hash_size+TDB_FREE_LISTS; i++) {
             if (tdb->fd != -1 && write(tdb->fd, buf, sizeof(tdb_off)) != 
                 sizeof(tdb_off)) {
                 tdb->ecode = TDB_ERR_IO;
@@ -585,19 +643,14 @@ static tdb_off tdb_find(TDB_CONTEXT *tdb, TDB_DATA key, unsigned int hash,
 			return 0;
 
 		if (hash == rec->full_hash && key.dsize == rec->key_len) {
-			char *k;
-			/* a very likely hit - read the key */
-			k = tdb_alloc_read(tdb, rec_ptr + sizeof(*rec), 
-					   rec->key_len);
-
-			if (!k)
-				return 0;
-
-			if (memcmp(key.dptr, k, key.dsize) == 0) {
-				free(k);
+			/* a very likely hit - compare the key */
+			switch (tdb_cmp(tdb, rec_ptr + sizeof(*rec),
+					key.dptr, rec->key_len)) {
+			case 0:
 				return rec_ptr;
+			case -1:
+				return 0;
 			}
-			free(k);
 		}
 
 		/* move to the next record */
@@ -713,6 +766,51 @@ TDB_DATA tdb_fetch(TDB_CONTEXT *tdb, TDB_DATA key)
 	return ret;
 }
 
+/* call parser on the data stored for a key, in place when the database
+   is mapped. The data is only valid during the call, and parser must
+   not modify the database. Returns the parser result, or -1 if the key
+   is not found */
+int tdb_parse_record(TDB_CONTEXT *tdb, TDB_DATA key,
+		     int (*parser)(TDB_DATA key, TDB_DATA data, void *state),
+		     void *state)
+{
+	unsigned hash;
+	tdb_off rec_ptr, offset;
+	struct list_struct rec;
+	TDB_DATA data;
+	int ret = -1;
+
+        if (tdb == NULL) {
+#ifdef TDB_DEBUG
+            printf("tdb_parse_record() called with null context\n");
+#endif
+            return -1;
+        }
+
+	/* find which hash bucket it is in */
+	hash = tdb_hash(&key);
+
+	tdb_lock(tdb, BUCKET(hash));
+	rec_ptr = tdb_find(tdb, key, hash, &rec);
+
+	if (rec_ptr) {
+		offset = rec_ptr + sizeof(rec) + rec.key_len;
+		data.dsize = rec.data_len;
+		if (tdb_oob(tdb, offset + rec.data_len) != 0) {
+			/* out of bounds */
+		} else if (tdb->map_ptr) {
+			data.dptr = offset + (char *)tdb->map_ptr;
+			ret = parser(key, data, state);
+		} else if ((data.dptr = tdb_alloc_read(tdb, offset, rec.data_len))) {
+			ret = parser(key, data, state);
+			free(data.dptr);
+		}
+	}
+
+	tdb_unlock(tdb, BUCKET(hash));
+	return ret;
+}
+
 /* check if an entry in the database exists 
 
    note that 1 is returned if the key is found and 0 is returned if not found
@@ -930,7 +1028,7 @@ int tdb_delete(TDB_CONTEXT *tdb, TDB_DATA key)
 	unsigned hash;
 	tdb_off offset, rec_ptr, last_ptr;
 	struct list_struct rec, lastrec;
-	char *data = NULL;
+	int cmp;
 
         if (tdb == NULL) {
 #ifdef TDB_DEBUG
@@ -961,14 +1059,14 @@ int tdb_delete(TDB_CONTEXT *tdb, TDB_DATA key)
 		}
 
 		if (hash == rec.full_hash && key.dsize == rec.key_len) {
-			/* a very likely hit - read the record and full key */
-			data = tdb_alloc_read(tdb, rec_ptr + sizeof(rec), 
-					     rec.key_len);
-			if (!data) {
+			/* a very likely hit - compare the full key */
+			cmp = tdb_cmp(tdb, rec_ptr + sizeof(rec),
+				      key.dptr, rec.key_len);
+			if (cmp == -1) {
 				goto fail;
 			}
 
-			if (memcmp(key.dptr, data, key.dsize) == 0) {
+			if (cmp == 0) {
 				/* a definite match - delete it */
 				if (last_ptr == 0) {
 					offset = tdb_hash_top(tdb, hash);
@@ -984,27 +1082,14 @@ int tdb_delete(TDB_CONTEXT *tdb, TDB_DATA key)
 				tdb_unlock(tdb, BUCKET(hash));
 				tdb_lock(tdb, -1);
 				/* and recover the space */
-				offset = FREELIST_TOP;
-				if (ofs_read(tdb, offset, &rec.next) == -1) {
-					goto fail2;
-				}
-				rec.magic = TDB_FREE_MAGIC;
-				if (rec_write(tdb, rec_ptr, &rec) == -1) {
-					goto fail2;
-				}
-				if (ofs_write(tdb, offset, &rec_ptr) == -1) {
+				if (tdb_free_push(tdb, rec_ptr, &rec) == -1) {
 					goto fail2;
 				}
 
 				/* yipee - all done */
-				free(data);
 				tdb_unlock(tdb, -1);
 				return 0;
 			}
-
-			/* a miss - drat */
-			free(data);
-			data = NULL;
 		}
 
 		/* move to the next record */
@@ -1014,12 +1099,10 @@ int tdb_delete(TDB_CONTEXT *tdb, TDB_DATA key)
 	}
 
  fail:
-	if (data) free(data);
 	tdb_unlock(tdb, BUCKET(hash));
 	return -1;
 
  fail2:
-	if (data) free(data);
 	tdb_unlock(tdb, -1);
 	return -1;
 }
@@ -96,4 +96,7 @@ int tdb_traverse(TDB_CONTEXT *tdb,
 	int (*fn)(TDB_CONTEXT *tdb, TDB_DATA key, TDB_DATA dbuf, void *state),
 	void *state);
 int tdb_exists(TDB_CONTEXT *tdb, TDB_DATA key);
+int tdb_parse_record(TDB_CONTEXT *tdb, TDB_DATA key,
+	int (*parser)(TDB_DATA key, TDB_DATA data, void *state),
+	void *state);
 #endif
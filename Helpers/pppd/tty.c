@@ -1216,6 +1216,33 @@ stop_charshunt(arg, sig)
 		kill(charshunt_pid, (int)(sig == SIGINT? sig: SIGTERM));
 }
 
+/*
+ * Buffer size for each direction of the character shunt:
+ * reads are not limited to one packet, to keep the number
+ * of system calls per byte low on fast streams.
+ */
+#define SHUNT_BUFSIZE	16384
+
+/*
+ * shunt_delay - return 0 if a write of n buffered bytes may start
+ * with the token bucket at `level', otherwise the number of usecs
+ * to wait for it to drain enough at max_data_rate.
+ * Waiting for room for a reasonable chunk avoids many tiny writes.
+ */
+static long
+shunt_delay(level, n, max_level)
+    int level, n, max_level;
+{
+    int chunk;
+
+    chunk = MIN(n, max_level / 4);
+    if (chunk < 1)
+	chunk = 1;
+    if (level + chunk <= max_level)
+	return 0;
+    return (long)((level + chunk - max_level) * 1e6 / max_data_rate) + 1;
+}
+
 /*
  * charshunt - the character shunt, which passes characters between
  * the pty master side and the serial port (or stdin/stdout).
@@ -1237,7 +1264,8 @@ charshunt(ifd, ofd, record_file)
     FILE *recordf = NULL;
     int ilevel, olevel, max_level;
     struct timeval levelt, tout, *top;
-    extern u_char inpacket_buf[];
+    long iwait, owait, wait;
+    u_char *ibuf, *obuf;
 
     /*
      * Reset signal handlers.
@@ -1315,6 +1343,11 @@ charshunt(ifd, ofd, record_file)
 	    warning("couldn't set stdout to nonblock: %m");
     }
 
+    ibuf = malloc(SHUNT_BUFSIZE);
+    obuf = malloc(SHUNT_BUFSIZE);
+    if (ibuf == NULL || obuf == NULL)
+	novm("charshunt buffers");
+
     nibuf = nobuf = 0;
     ibufp = obufp = NULL;
     pty_readable = stdin_readable = 1;
@@ -1326,7 +1359,7 @@ charshunt(ifd, ofd, record_file)
 	if (max_level < 100)
 	    max_level = 100;
     } else
-	max_level = PPP_MRU + PPP_HDRLEN + 1;
+	max_level = SHUNT_BUFSIZE + 1;
 
     nfds = (ofd > pty_master? ofd: pty_master) + 1;
     if (recordf != NULL) {
@@ -1340,25 +1373,28 @@ charshunt(ifd, ofd, record_file)
     }
 
     while (nibuf != 0 || nobuf != 0 || pty_readable || stdin_readable) {
-	top = 0;
-	tout.tv_sec = 0;
-	tout.tv_usec = 10000;
 	FD_ZERO(&ready);
 	FD_ZERO(&writey);
+	iwait = owait = 0;
 	if (nibuf != 0) {
-	    if (ilevel >= max_level)
-		top = &tout;
-	    else
+	    if ((iwait = shunt_delay(ilevel, nibuf, max_level)) == 0)
 		FD_SET(pty_master, &writey);
 	} else if (stdin_readable)
 	    FD_SET(ifd, &ready);
 	if (nobuf != 0) {
-	    if (olevel >= max_level)
-		top = &tout;
-	    else
+	    if ((owait = shunt_delay(olevel, nobuf, max_level)) == 0)
 		FD_SET(ofd, &writey);
 	} else if (pty_readable)
 	    FD_SET(pty_master, &ready);
+
+	/* sleep until the token bucket lets a throttled direction go */
+	top = NULL;
+	wait = (iwait && owait)? MIN(iwait, owait): iwait + owait;
+	if (wait) {
+	    tout.tv_sec = wait / 1000000;
+	    tout.tv_usec = (int)(wait % 1000000);
+	    top = &tout;
+	}
 	if (select(nfds, &ready, &writey, NULL, top) < 0) {
 	    if (errno != EINTR)
 		fatal("select");
@@ -1379,8 +1415,8 @@ charshunt(ifd, ofd, record_file)
 	} else
 	    ilevel = olevel = 0;
 	if (FD_ISSET(ifd, &ready)) {
-	    ibufp = inpacket_buf;
-	    nibuf = (int)read(ifd, ibufp, PPP_MRU + PPP_HDRLEN);
+	    ibufp = ibuf;
+	    nibuf = (int)read(ifd, ibufp, SHUNT_BUFSIZE);
 	    if (nibuf < 0 && errno == EIO)
 		nibuf = 0;
 	    if (nibuf < 0) {
@@ -1394,7 +1430,7 @@ charshunt(ifd, ofd, record_file)
 		stdin_readable = 0;
 		/* do a 0-length write, hopefully this will generate
 		   an EOF (hangup) on the slave side. */
-		write(pty_master, inpacket_buf, 0);
+		write(pty_master, ibuf, 0);
 		if (recordf)
 		    if (!record_write(recordf, 4, NULL, 0, &lasttime))
 			recordf = NULL;
@@ -1406,8 +1442,8 @@ charshunt(ifd, ofd, record_file)
 	    }
 	}
 	if (FD_ISSET(pty_master, &ready)) {
-	    obufp = outpacket_buf;
-	    nobuf = (int)read(pty_master, obufp, PPP_MRU + PPP_HDRLEN);
+	    obufp = obuf;
+	    nobuf = (int)read(pty_master, obufp, SHUNT_BUFSIZE);
 	    if (nobuf < 0 && errno == EIO)
 		nobuf = 0;
 	    if (nobuf < 0) {
@@ -69,11 +69,14 @@
 #include <netdb.h>
 #include <time.h>
 #include <pwd.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <sys/param.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -92,6 +95,7 @@
 #include "pppd.h"
 #include "fsm.h"
 #include "lcp.h"
+#include "pathnames.h"
 
 #ifndef lint
 static const char rcsid[] = RCSID;
@@ -103,6 +107,11 @@ extern char *strerror();
 
 static void logit __P((int, char *, va_list));
 static void log_write __P((int, char *));
+static int log_output __P((int, char *, time_t, int));
+static int log_queue __P((int, const char *, u_char *, int));
+static int log_queue_packet __P((int, const char *, u_char *, int));
+static int log_put_lock __P((void));
+static void log_put_unlock __P((void));
 static void vslp_printer __P((void *, char *, ...));
 static void format_packet __P((u_char *, int, void (*) (void *, char *, ...),
 			       void *));
@@ -739,30 +748,309 @@ static void
 log_write(level, buf)
     int level;
     char *buf;
+{
+	if (!log_queue(level, buf, NULL, 0) && log_output(level, buf, time(NULL), log_to_fd) < 0)
+		log_to_fd = -1;
+}
+
+/*
+ * log_output - write a message to syslog and the log file fd,
+ * t is the time the message was logged at.
+ * Return -1 if fd could not be written to.
+ */
+static int
+log_output(level, buf, t, fd)
+    int level;
+    char *buf;
+    time_t t;
+    int fd;
 {
 #ifdef __APPLE__
-	time_t t;
 	int ns;
 	char s[64];
+	struct tm tm;
 #endif
 
 	sys_log(level, "%s", buf);
-	if (log_to_fd >= 0 && (level != LOG_DEBUG || debug)) {
+	if (fd >= 0 && (level != LOG_DEBUG || debug)) {
 		int n = (int)strlen(buf);
 
 #ifdef __APPLE__
-		time(&t);
-		ns = (int)strftime(s, sizeof(s), "%c : ", localtime(&t));
-		if (write(log_to_fd, s, ns) != ns)
-			log_to_fd = -1;
+		ns = (int)strftime(s, sizeof(s), "%c : ", localtime_r(&t, &tm));
+		if (write(fd, s, ns) != ns)
+			return -1;
 #endif
 
 		if (n > 0 && buf[n-1] == '\n')
 			--n;
-		if (write(log_to_fd, buf, n) != n
-			|| write(log_to_fd, "\n", 1) != 1)
-			log_to_fd = -1;
+		if (write(fd, buf, n) != n
+			|| write(fd, "\n", 1) != 1)
+			return -1;
 	}
+	return 0;
+}
+
+/*
+ * Asynchronous logging, enabled with the asynclog option.
+ * Messages are formatted by the thread that logs them, queued in a ring,
+ * and written to syslog and the log file by a low priority thread,
+ * so that the main loop never waits on them.
+ * Packet dumps are queued as the raw packet instead, and formatted by
+ * the log thread.
+ * Once started, every thread of the process logs through the ring, in order.
+ * When the ring is full, messages are dropped and counted, nothing waits
+ * for room.  The log thread doesn't survive a fork: detach() stops it
+ * and starts it again in the child, other children log directly.
+ */
+#define LOG_RING_SIZE	128		/* records, power of 2 */
+#define LOG_RECLEN	4096		/* message bytes per record */
+
+struct log_rec {
+    int		level;
+    int		fd;			/* log_to_fd when the message was logged */
+    time_t	time;
+    int		pktlen;			/* -1, or packet bytes after the tag in data */
+    char	data[LOG_RECLEN];
+};
+
+static struct log_rec *log_ring;
+static atomic_uint log_head;		/* next record to fill */
+static atomic_uint log_tail;		/* next record to write */
+static atomic_int log_idle;		/* log thread is waiting for records */
+static atomic_int log_bad_fd;		/* fd the log thread failed to write to, or -1 */
+static int log_stopping;		/* log thread must exit when done */
+static unsigned log_dropped;		/* records lost to a full ring */
+static pid_t log_pid;
+static pthread_t log_thread;
+static pthread_mutex_t log_put_mutex = PTHREAD_MUTEX_INITIALIZER; /* serializes producers */
+static __thread int log_put_held;	/* this thread holds log_put_mutex */
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;	/* records to write */
+
+/*
+ * log_put_lock - take log_put_mutex, return -1 if this thread already
+ * holds it, i.e. we are in a signal handler that interrupted a producer.
+ */
+static int
+log_put_lock()
+{
+    if (log_put_held)
+	return -1;
+    pthread_mutex_lock(&log_put_mutex);
+    log_put_held = 1;
+    return 0;
+}
+
+static void
+log_put_unlock()
+{
+    log_put_held = 0;
+    pthread_mutex_unlock(&log_put_mutex);
+}
+
+/*
+ * log_enqueue - add a record to the ring, with log_put_mutex held.
+ * With pkt, data is the tag of a packet dump, and the packet is
+ * copied after it.  Return 0 if the ring is full.
+ */
+static int
+log_enqueue(level, data, pkt, pktlen)
+    int level;
+    const char *data;
+    u_char *pkt;
+    int pktlen;
+{
+    unsigned head = atomic_load_explicit(&log_head, memory_order_relaxed);
+    struct log_rec *rec;
+    size_t n;
+
+    if (head - atomic_load(&log_tail) >= LOG_RING_SIZE)
+	return 0;
+
+    rec = &log_ring[head & (LOG_RING_SIZE - 1)];
+    rec->level = level;
+    rec->fd = log_to_fd;
+    rec->time = time(NULL);
+    rec->pktlen = -1;
+    n = strlcpy(rec->data, data, sizeof(rec->data));
+    if (pkt != NULL) {
+	memcpy(rec->data + n + 1, pkt, pktlen);
+	rec->pktlen = pktlen;
+    }
+
+    /* publish the record, then wake up the log thread if it sleeps */
+    atomic_store(&log_head, head + 1);
+    if (atomic_load(&log_idle)) {
+	pthread_mutex_lock(&log_mutex);
+	pthread_cond_signal(&log_cond);
+	pthread_mutex_unlock(&log_mutex);
+    }
+    return 1;
+}
+
+/*
+ * log_queue - queue a message, or a packet dump with pkt, for the log thread.
+ * Return 0 if the caller must write it out itself.
+ */
+static int
+log_queue(level, data, pkt, pktlen)
+    int level;
+    const char *data;
+    u_char *pkt;
+    int pktlen;
+{
+    char buf[64];
+    int fd;
+
+    if (log_ring == NULL || getpid() != log_pid
+	|| log_put_lock() < 0)
+	return 0;
+    if (log_ring == NULL) {
+	log_put_unlock();
+	return 0;
+    }
+
+    /* the log thread can't change log_to_fd, it is done here */
+    if ((fd = atomic_exchange(&log_bad_fd, -1)) >= 0 && fd == log_to_fd)
+	log_to_fd = -1;
+    if (log_dropped) {
+	slprintf(buf, sizeof(buf), "%u log messages dropped", log_dropped);
+	if (log_enqueue(LOG_WARNING, buf, NULL, 0))
+	    log_dropped = 0;
+    }
+    if (!log_enqueue(level, data, pkt, pktlen))
+	log_dropped++;
+    log_put_unlock();
+    return 1;
+}
+
+/*
+ * log_queue_packet - queue a packet dump, formatted as "tag %P" by the
+ * log thread.  Return 0 if the caller must format and log it itself.
+ */
+static int
+log_queue_packet(level, tag, p, len)
+    int level;
+    const char *tag;
+    u_char *p;
+    int len;
+{
+    if (log_ring == NULL || len < 0
+	|| strlen(tag) + 1 + len > LOG_RECLEN)
+	return 0;
+    return log_queue(level, tag, p, len);
+}
+
+/*
+ * log_thread_main - write out the queued records.
+ */
+static void *
+log_thread_main(arg)
+    void *arg;
+{
+    unsigned tail;
+    struct log_rec *rec;
+    char *msg;
+    char buf[LOG_RECLEN];
+    int done;
+
+#ifdef __APPLE__
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+
+    for (;;) {
+	tail = atomic_load_explicit(&log_tail, memory_order_relaxed);
+	while (tail != atomic_load_explicit(&log_head, memory_order_acquire)) {
+	    rec = &log_ring[tail & (LOG_RING_SIZE - 1)];
+	    msg = rec->data;
+	    if (rec->pktlen >= 0) {
+		slprintf(buf, sizeof(buf), "%s %P", rec->data,
+			 rec->data + strlen(rec->data) + 1, rec->pktlen);
+		msg = buf;
+	    }
+	    if (log_output(rec->level, msg, rec->time, rec->fd) < 0)
+		atomic_store(&log_bad_fd, rec->fd);
+	    atomic_store(&log_tail, ++tail);
+	}
+
+	pthread_mutex_lock(&log_mutex);
+	atomic_store(&log_idle, 1);
+	while (!log_stopping && tail == atomic_load(&log_head))
+	    pthread_cond_wait(&log_cond, &log_mutex);
+	atomic_store(&log_idle, 0);
+	done = log_stopping && tail == atomic_load(&log_head);
+	pthread_mutex_unlock(&log_mutex);
+	if (done)
+	    break;
+    }
+    return NULL;
+}
+
+/*
+ * log_async_start - start the log thread, logging from this process
+ * will go through it from now on.
+ */
+void
+log_async_start()
+{
+    sigset_t mask, omask;
+
+    if (log_ring != NULL)
+	return;
+    if ((log_ring = malloc(LOG_RING_SIZE * sizeof(struct log_rec))) == NULL) {
+	warning("Couldn't allocate log ring, logging synchronously");
+	return;
+    }
+    atomic_store(&log_head, 0);
+    atomic_store(&log_tail, 0);
+    atomic_store(&log_idle, 0);
+    atomic_store(&log_bad_fd, -1);
+    log_stopping = 0;
+    log_dropped = 0;
+
+    /* signals are for the main loop, the log thread blocks them all */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_SETMASK, &mask, &omask);
+    if (pthread_create(&log_thread, NULL, log_thread_main, NULL)) {
+	pthread_sigmask(SIG_SETMASK, &omask, NULL);
+	free(log_ring);
+	log_ring = NULL;
+	warning("Couldn't start log thread, logging synchronously");
+	return;
+    }
+    pthread_sigmask(SIG_SETMASK, &omask, NULL);
+    log_pid = getpid();
+}
+
+/*
+ * log_async_stop - write out pending records and stop the log thread,
+ * logging is synchronous again.
+ */
+void
+log_async_stop()
+{
+    int fd;
+
+    if (log_ring == NULL || getpid() != log_pid)
+	return;
+
+    /* keep producers out while the ring drains, they log directly after */
+    if (log_put_lock() < 0)
+	return;
+    pthread_mutex_lock(&log_mutex);
+    log_stopping = 1;
+    pthread_cond_signal(&log_cond);
+    pthread_mutex_unlock(&log_mutex);
+    pthread_join(log_thread, NULL);
+
+    free(log_ring);
+    log_ring = NULL;
+    log_put_unlock();
+
+    if ((fd = atomic_exchange(&log_bad_fd, -1)) >= 0 && fd == log_to_fd)
+	log_to_fd = -1;
+    if (log_dropped)
+	warning("%u log messages dropped", log_dropped);
 }
 
 /*
@@ -923,9 +1211,425 @@ dump_packet(const char *tag, unsigned char *p, int len)
 	    return;
     }
 
+    /*
+     * with asynclog, control packets are formatted by the log thread.
+     * EAP packets are printed by the EAP plugins, which we can't
+     * assume to be thread safe, and data packets may go to a plugin hook.
+     */
+    if (proto >= 0x8000 && proto != PPP_EAP
+	&& log_queue_packet(LOG_DEBUG, tag, p, len))
+	return;
     dbglog("%s %P", tag, p, len);
 }
 
+/*
+ * Packet capture, enabled with the pcapfile option.
+ * Packets seen by the snoop hooks are recorded as pcapng
+ * (DLT_PPP_WITH_DIR, nanosecond timestamps) whatever the channel is.
+ * Blocks are staged in memory and written once a second, or when the
+ * buffer is full, and the file is rotated by size and/or age.
+ */
+#define PCAPNG_SHB		0x0A0D0D0A
+#define PCAPNG_IDB		0x00000001
+#define PCAPNG_EPB		0x00000006
+#define PCAPNG_BOM		0x1A2B3C4D
+#define PCAP_DLT_PPP_WITH_DIR	204
+#define PCAP_BUFSIZE		65536
+
+static int pcap_fd = -1;
+static u_char *pcap_buf;		/* blocks waiting to be written */
+static int pcap_len;
+static off_t pcap_size;			/* bytes in the current file */
+static time_t pcap_opened;		/* when the current file was opened */
+static void (*pcap_prev_recv) __P((unsigned char *, int));
+static void (*pcap_prev_send) __P((unsigned char *, int));
+
+static void pcap_flush __P((void));
+static void pcap_unhook __P((void));
+static int pcap_open __P((void));
+static void pcap_packet __P((int, unsigned char *, int));
+
+static void
+pcap_put32(p, v)
+    u_char *p;
+    u_int32_t v;
+{
+    memcpy(p, &v, 4);
+}
+
+/*
+ * pcap_headers - stage the section and interface blocks starting a file.
+ */
+static void
+pcap_headers()
+{
+    u_char *p = pcap_buf + pcap_len;
+
+    /* section header: byte order magic, version 1.0, unknown length */
+    pcap_put32(p, PCAPNG_SHB);
+    pcap_put32(p + 4, 28);
+    pcap_put32(p + 8, PCAPNG_BOM);
+    *(u_int16_t *)(p + 12) = 1;		/* version 1.0 */
+    *(u_int16_t *)(p + 14) = 0;
+    pcap_put32(p + 16, 0xffffffff);
+    pcap_put32(p + 20, 0xffffffff);
+    pcap_put32(p + 24, 28);
+    p += 28;
+
+    /* interface description: link type, no snaplen, if_tsresol = 10^-9 */
+    pcap_put32(p, PCAPNG_IDB);
+    pcap_put32(p + 4, 32);
+    *(u_int16_t *)(p + 8) = PCAP_DLT_PPP_WITH_DIR;
+    *(u_int16_t *)(p + 10) = 0;
+    pcap_put32(p + 12, 0);
+    *(u_int16_t *)(p + 16) = 9;		/* if_tsresol */
+    *(u_int16_t *)(p + 18) = 1;
+    p[20] = 9; p[21] = 0; p[22] = 0; p[23] = 0;
+    pcap_put32(p + 24, 0);		/* opt_endofopt */
+    pcap_put32(p + 28, 32);
+
+    pcap_len += 60;
+}
+
+/*
+ * pcap_open - open the capture file, rotating older ones out of the way.
+ */
+static int
+pcap_open()
+{
+    char from[MAXPATHLEN], to[MAXPATHLEN];
+    int i;
+
+    if (pcap_files > 1) {
+	for (i = pcap_files - 1; i > 0; i--) {
+	    if (i > 1)
+		slprintf(from, sizeof(from), "%s.%d", pcap_file, i - 1);
+	    else
+		strlcpy(from, pcap_file, sizeof(from));
+	    slprintf(to, sizeof(to), "%s.%d", pcap_file, i);
+	    rename(from, to);
+	}
+    }
+
+    pcap_fd = open(pcap_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (pcap_fd < 0) {
+	error("Couldn't create capture file %s: %m", pcap_file);
+	return 0;
+    }
+    fcntl(pcap_fd, F_SETFD, FD_CLOEXEC);
+    pcap_size = 0;
+    pcap_opened = time(NULL);
+    pcap_headers();
+    return 1;
+}
+
+/*
+ * pcap_flush - write the staged blocks, and rotate the file if needed.
+ */
+static void
+pcap_flush()
+{
+    int n, done;
+
+    for (done = 0; done < pcap_len; done += n) {
+	n = (int)write(pcap_fd, pcap_buf + done, pcap_len - done);
+	if (n < 0) {
+	    if (errno == EINTR) {
+		n = 0;
+		continue;
+	    }
+	    error("Error writing capture file %s: %m", pcap_file);
+	    break;
+	}
+    }
+    pcap_size += done;
+    pcap_len = 0;
+
+    if ((pcap_maxsize > 0 && pcap_size >= (off_t)pcap_maxsize * 1024)
+	|| (pcap_interval > 0 && time(NULL) - pcap_opened >= pcap_interval)) {
+	close(pcap_fd);
+	if (!pcap_open())
+	    pcap_unhook();		/* pcap_fd is already -1 */
+    }
+}
+
+static void
+pcap_timer(arg)
+    void *arg;
+{
+    if (pcap_fd < 0)
+	return;
+    if (pcap_len > 0 || pcap_interval > 0)
+	pcap_flush();
+    if (pcap_fd >= 0)
+	timeout(pcap_timer, NULL, 1, 0);
+}
+
+/*
+ * pcap_packet - stage an enhanced packet block.
+ * dir is 0 for received packets and 1 for sent ones.
+ */
+static void
+pcap_packet(dir, p, len)
+    int dir;
+    unsigned char *p;
+    int len;
+{
+    struct timespec ts;
+    u_int64_t ns;
+    int caplen, blen;
+    u_char *b;
+
+    if (pcap_fd < 0)
+	return;
+
+    caplen = MIN(len + 1, PCAP_BUFSIZE - 64);
+    blen = 28 + ((caplen + 3) & ~3) + 4;
+    if (pcap_len + blen > PCAP_BUFSIZE) {
+	pcap_flush();
+	if (pcap_fd < 0)
+	    return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ns = (u_int64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    b = pcap_buf + pcap_len;
+    pcap_put32(b, PCAPNG_EPB);
+    pcap_put32(b + 4, blen);
+    pcap_put32(b + 8, 0);			/* interface id */
+    pcap_put32(b + 12, (u_int32_t)(ns >> 32));
+    pcap_put32(b + 16, (u_int32_t)ns);
+    pcap_put32(b + 20, caplen);
+    pcap_put32(b + 24, len + 1);
+    b[28] = dir;
+    memcpy(b + 29, p, caplen - 1);
+    memset(b + 28 + caplen, 0, blen - 32 - caplen);
+    pcap_put32(b + blen - 4, blen);
+    pcap_len += blen;
+}
+
+static void
+pcap_recv(p, len)
+    unsigned char *p;
+    int len;
+{
+    pcap_packet(0, p, len);
+    if (pcap_prev_recv)
+	pcap_prev_recv(p, len);
+}
+
+static void
+pcap_send(p, len)
+    unsigned char *p;
+    int len;
+{
+    pcap_packet(1, p, len);
+    if (pcap_prev_send)
+	pcap_prev_send(p, len);
+}
+
+static void
+pcap_exitnotify(arg, status)
+    void *arg;
+    int status;
+{
+    pcap_stop();
+}
+
+/*
+ * pcap_start - start recording packets to pcap_file.
+ */
+void
+pcap_start()
+{
+    if (pcap_file == NULL || pcap_fd >= 0)
+	return;
+    if (pcap_buf == NULL && (pcap_buf = malloc(PCAP_BUFSIZE)) == NULL) {
+	error("Couldn't allocate capture buffer");
+	return;
+    }
+    pcap_len = 0;
+    if (!pcap_open())
+	return;
+
+    pcap_prev_recv = snoop_recv_hook;
+    pcap_prev_send = snoop_send_hook;
+    snoop_recv_hook = pcap_recv;
+    snoop_send_hook = pcap_send;
+    add_notifier(&exitnotify, pcap_exitnotify, 0);
+    timeout(pcap_timer, NULL, 1, 0);
+}
+
+/*
+ * pcap_stop - write what is pending and close the capture file.
+ */
+void
+pcap_stop()
+{
+    if (pcap_fd < 0)
+	return;
+    if (pcap_len > 0) {
+	pcap_maxsize = pcap_interval = 0;	/* no rotation on the way out */
+	pcap_flush();
+    }
+    close(pcap_fd);
+    pcap_fd = -1;
+    pcap_unhook();
+}
+
+/*
+ * pcap_unhook - stop seeing packets, once the capture file is closed.
+ */
+static void
+pcap_unhook()
+{
+    untimeout(pcap_timer, NULL);
+    snoop_recv_hook = pcap_prev_recv;
+    snoop_send_hook = pcap_prev_send;
+    remove_notifier(&exitnotify, pcap_exitnotify, 0);
+}
+
+/*
+ * Option cache, enabled with the optcache option.
+ * A protocol saves the options it agreed with the peer once it is up,
+ * and the next connection to the same remoteaddress starts from them
+ * instead of going through the same Nak/Reject round trips again.
+ * There is one small file per protocol and peer in _PATH_VARRUN;
+ * a record is only taken back for the same peer, pppd version and
+ * options structure size.
+ */
+#define OPTCACHE_MAGIC	0x70706f63
+
+struct optcache_hdr {
+    u_int32_t	magic;
+    u_int32_t	peerlen;	/* followed by the peer address */
+    u_int32_t	len;		/* and the options */
+    char	version[16];
+};
+
+/*
+ * optcache_path - name of the cache file for proto and the current peer,
+ * 0 if there is nothing to cache against.
+ */
+static int
+optcache_path(proto, path, len)
+    char *proto;
+    char *path;
+    int len;
+{
+    u_int32_t h = 2166136261U;
+    u_char *p;
+
+    if (!optcache || remoteaddress == NULL || *remoteaddress == 0)
+	return 0;
+    for (p = (u_char *) remoteaddress; *p != 0; ++p)
+	h = (h ^ *p) * 16777619U;
+    slprintf(path, len, "%s%s-%x.cache", _PATH_OPTCACHE, proto, h);
+    return 1;
+}
+
+/*
+ * optcache_load - fill data with the options cached for the peer,
+ * returns 1 if there were some.
+ */
+int
+optcache_load(proto, data, len)
+    char *proto;
+    void *data;
+    int len;
+{
+    char path[MAXPATHLEN];
+    struct optcache_hdr *hdr;
+    int fd, plen, total, ok;
+    u_char *buf;
+
+    if (!optcache_path(proto, path, sizeof(path)))
+	return 0;
+    if ((fd = open(path, O_RDONLY | O_NOFOLLOW)) < 0)
+	return 0;
+    plen = strlen(remoteaddress);
+    total = sizeof(*hdr) + plen + len;
+    if ((buf = malloc(total + 1)) == NULL) {
+	close(fd);
+	return 0;
+    }
+    /* reading one byte more than expected catches a longer record */
+    ok = complete_read(fd, buf, total + 1) == total;
+    close(fd);
+
+    hdr = (struct optcache_hdr *) buf;
+    ok = ok && hdr->magic == OPTCACHE_MAGIC && hdr->peerlen == plen
+	&& hdr->len == len
+	&& strncmp(hdr->version, VERSION, sizeof(hdr->version)) == 0
+	&& memcmp(hdr + 1, remoteaddress, plen) == 0;
+    if (ok)
+	memcpy(data, buf + sizeof(*hdr) + plen, len);
+    free(buf);
+    return ok;
+}
+
+/*
+ * optcache_save - remember the options agreed with the peer.
+ * The record is written aside and renamed over the old one,
+ * so a concurrent reader never sees half of it.
+ */
+void
+optcache_save(proto, data, len)
+    char *proto;
+    void *data;
+    int len;
+{
+    char path[MAXPATHLEN], tmp[MAXPATHLEN];
+    struct optcache_hdr hdr;
+    struct iovec iov[3];
+    int fd, total;
+    ssize_t n;
+
+    if (!optcache_path(proto, path, sizeof(path)))
+	return;
+    slprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+	dbglog("Couldn't create %s: %m", tmp);
+	return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = OPTCACHE_MAGIC;
+    hdr.peerlen = strlen(remoteaddress);
+    hdr.len = len;
+    strlcpy(hdr.version, VERSION, sizeof(hdr.version));
+    iov[0].iov_base = (void *) &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = remoteaddress;
+    iov[1].iov_len = hdr.peerlen;
+    iov[2].iov_base = data;
+    iov[2].iov_len = len;
+    total = sizeof(hdr) + hdr.peerlen + len;
+
+    n = writev(fd, iov, 3);
+    close(fd);
+    if (n != total || rename(tmp, path) < 0) {
+	dbglog("Couldn't save %s: %m", path);
+	unlink(tmp);
+    }
+}
+
+/*
+ * optcache_forget - drop the options cached for the peer,
+ * they didn't get us anywhere.
+ */
+void
+optcache_forget(proto)
+    char *proto;
+{
+    char path[MAXPATHLEN];
+
+    if (optcache_path(proto, path, sizeof(path)))
+	unlink(path);
+}
+
 /*
  * complete_read - read a full `count' bytes from fd,
  * unless end-of-file or an error other than EINTR is encountered.
@@ -1949,6 +1949,7 @@ install_remove_routes(struct service *serv, int cmd, CFDictionaryRef ipsec_dict,
 	CFIndex	start, end;
     int 			len;
     int 			rtm_seq = 0;
+    int 			off = 0;
 
     struct {
 	struct rt_msghdr	hdr;
@@ -1968,6 +1969,8 @@ install_remove_routes(struct service *serv, int cmd, CFDictionaryRef ipsec_dict,
 	s = socket(PF_ROUTE, SOCK_RAW, PF_ROUTE);
 	if (s < 0)
 		FAIL("cannot open a routing socket");
+	// errors are returned by write, we never read our own messages back
+	setsockopt(s, SOL_SOCKET, SO_USELOOPBACK, &off, sizeof(off));
     
 	if (!GetStrAddrFromDict(ipsec_dict, kRASPropIPSecLocalAddress, src_address, sizeof(src_address)))
 		FAIL("incorrect local address");